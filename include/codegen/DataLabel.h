@@ -1,3 +1,5 @@
+#pragma once
+
 #include "stl.h"
 #include "data/Constant.h"
 
@@ -6,34 +6,21 @@
 
 namespace soft {
   namespace codegen {
-    class Memory {
-      public:
-        Memory(Type type, size_t offset);
-        Memory();
-
-        Type& getType();
-        const Type& getType() const;
-        size_t getOffset() const;
-
-        void setType(Type type);
-        void setOffset(size_t offset);
-
-        std::string toString() const;
-
-      private:
-        Type type;
-        size_t offset;
-    };
     class Register {
       public:
         enum class Knd : int {
           RAX = 0, RCX, RDX, RSI, RDI,
-          R8, R9, R10, R11, XMM0 , XMM1,
+          R8, R9, R10, R11, RBX, R12,
+          R13, R14, R15, RBP, RSP,
+          XMM0 , XMM1,
           XMM2, XMM3, XMM4, XMM5, XMM6,
           XMM7, XMM8, XMM9, XMM10, XMM11,
           XMM12, XMM13, XMM14, XMM15
         };
 
+        // returns true if a function must preserve the register (SysV)
+        bool isCalleeSaved() const;
+
         Register(Type type, Knd knd);
         Register();
 
@@ -50,6 +37,41 @@ namespace soft {
         Type type;
         Knd knd;
     };
+    class Memory {
+      public:
+        // the value is at `offset(%base)`
+        Memory(Type type, off_t offset, Register::Knd base = Register::Knd::RBP);
+        // the value is at `offset(%base, %index, scale)`
+        Memory(Type type, off_t offset, Register::Knd base, Register::Knd index, size_t scale);
+        // the value is at `symbol(%rip)`
+        Memory(Type type, std::string symbol);
+        Memory();
+
+        Type& getType();
+        const Type& getType() const;
+        off_t getOffset() const;
+        Register::Knd getBase() const;
+        std::optional<Register::Knd> getIndex() const;
+        size_t getScale() const;
+        const std::optional<std::string>& getSymbol() const;
+
+        void setType(Type type);
+        void setOffset(off_t offset);
+        void setBase(Register::Knd base);
+        void setIndex(std::optional<Register::Knd> index);
+        void setScale(size_t scale);
+        void setSymbol(std::optional<std::string> symbol);
+
+        std::string toString() const;
+
+      private:
+        Type type;
+        off_t offset;
+        Register::Knd base;
+        std::optional<Register::Knd> index;
+        size_t scale = 1;
+        std::optional<std::string> symbol;
+    };
     class Storage {
       public:
         Storage(Memory value);
@@ -79,5 +101,9 @@ namespace soft {
       private:
         std::variant<Memory, Register> value;
     };
+
+    // returns true if the values of the type live in the xmm registers:
+    // the floating points and the vectors
+    bool uses_xmm(const Type& type);
   }
 }
@@ -1,9 +1,10 @@
 #pragma once
 
 #include "ir/Program.h"
+#include "opts.h"
 
 namespace soft {
   namespace codegen {
-    std::string generate(Program& program);
+    std::string generate(Program& program, const Opts& opts);
   }
 }
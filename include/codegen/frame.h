@@ -0,0 +1,46 @@
+#pragma once
+
+#include "stl.h"
+#include "ir/Program.h"
+#include "codegen/Storage.h"
+#include "codegen/regalloc.h"
+
+namespace soft {
+  namespace codegen {
+    // a value that lives in the stack frame and the instructions
+    // where it holds a value, the terminator counts as the
+    // instruction after the body
+    struct StackObject {
+      // the slot kept in the object, empty for the
+      // callee-saved registers
+      std::optional<size_t> slot;
+      Type type;
+      size_t start;
+      size_t end;
+      // set by `layout_frame()`, the object is at -offset(%rbp)
+      size_t offset = 0;
+    };
+
+    // the bytes below %rsp that a leaf function may use without
+    // moving it (SysV red zone)
+    static constexpr size_t red_zone_size = 128;
+
+    // returns true if the function returns the result of its last instruction,
+    // a call whose arguments all fit in registers, the callee then reuses
+    // the frame of the caller
+    bool is_tail_call(const Function& fn);
+    // returns true if the function calls no other function, except in a
+    // tail call, it doesn't need a frame pointer or an aligned %rsp then
+    bool is_leaf(const Function& fn);
+
+    // returns the variables, the spilled temporaries and the parameters
+    // that live in the frame, `allocation` is the result of the register allocator
+    std::vector<StackObject> stack_objects(const Function& fn, const std::vector<Interval>& intervals, const std::unordered_map<size_t, Storage>& allocation);
+
+    // gives every object an offset aligned to its size (to the element
+    // size for the arrays), the objects that
+    // are never alive at the same time share their memory (stack slot coloring),
+    // returns the size of the frame which is a multiple of 16
+    size_t layout_frame(std::vector<StackObject>& objects);
+  }
+}
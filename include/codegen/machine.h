@@ -0,0 +1,175 @@
+#pragma once
+
+#include "stl.h"
+#include "codegen/Storage.h"
+
+namespace soft {
+  namespace codegen {
+    // returns the AT&T suffix of the type: b, w, l, q for the
+    // integers and s, d for the floating points
+    char suffix(const Type& type);
+
+    class Immediate {
+      public:
+        Immediate(int64_t value);
+        Immediate();
+
+        int64_t getValue() const;
+
+        void setValue(int64_t value);
+
+        std::string toString() const;
+
+      private:
+        int64_t value;
+    };
+    // a function or a label, or the data at a label
+    // when it has a type (`name(%rip)`)
+    class Symbol {
+      public:
+        Symbol(std::string name);
+        Symbol(Type type, std::string name);
+        Symbol();
+
+        // returns true if the operand is the data at the symbol
+        bool isData() const;
+
+        Type& getType();
+        const Type& getType() const;
+        const std::string& getName() const;
+
+        void setType(Type type);
+        void setName(std::string name);
+
+        std::string toString() const;
+
+      private:
+        std::optional<Type> type;
+        std::string name;
+    };
+    class Operand {
+      public:
+        Operand(Register value);
+        Operand(Memory value);
+        Operand(Immediate value);
+        Operand(Symbol value);
+        Operand(Storage value);
+        Operand();
+
+        bool isRegister() const;
+        bool isMemory() const;
+        bool isImmediate() const;
+        bool isSymbol() const;
+        // Returns:
+        //   0: if the value inside is of type `Register`
+        //   1: if the value inside is of type `Memory`
+        //   2: if the value inside is of type `Immediate`
+        //   3: if the value inside is of type `Symbol`
+        size_t getIndex() const;
+
+        Register& getRegister();
+        Memory& getMemory();
+        Immediate& getImmediate();
+        Symbol& getSymbol();
+        // the type of a register or the data in memory
+        const Type& getType() const;
+
+        const Register& getRegister() const;
+        const Memory& getMemory() const;
+        const Immediate& getImmediate() const;
+        const Symbol& getSymbol() const;
+
+        // returns the register itself or the registers of the address
+        std::vector<Register::Knd> getRegisters() const;
+
+        std::string toString() const;
+
+      private:
+        std::variant<Register, Memory, Immediate, Symbol> value;
+    };
+
+    // an x86-64 instruction, the operand size comes from the operands
+    // and the operands are in the AT&T order, the destination last.
+    // the floating point arithmetic with three operands is the VEX
+    // form: `op c, b, a` is a = b op c
+    class MachineInstruction {
+      public:
+        enum class Opcode {
+          Mov, Movabs, Movsx, Movzx, Lea,
+          Add, Sub, Imul, Mul, Div, Idiv,
+          And, Xor, Shl, Shr, Sar, Neg,
+          Cqto, Cltd, Cvtsi2s, Cvtts2si, Cvts2s,
+          // VEX, `op c, b, a`: a = b * c + a, a = b * c - a, a = -(b * c) + a
+          Fmadd, Fmsub, Fnmadd,
+          // the 16 bytes of an xmm register from or to memory
+          Movups,
+          // the low lane of an xmm register to a general one
+          Movd,
+          // `pshufd $order, src, dst`, `vextractf128 $1, ymm, xmm` and
+          // `vpermps src, indices, dst`
+          Pshufd, Vextractf128, Vpermps,
+          // copies %rcx bytes from (%rsi) to (%rdi)
+          RepMovsb,
+          // clears the upper part of the ymm registers before the code
+          // that may use SSE, mixing them with dirty ymm is slow
+          Vzeroupper,
+          Push, Pop, Leave, Call, Jmp, Ret,
+          // jumps if the last arithmetic didn't give 0, closes the array
+          // copy loops, the only code that reads the flags
+          Jne,
+          // not an instruction, the symbol is defined here
+          Label,
+        };
+
+        MachineInstruction(Opcode opcode, std::vector<Operand> operands = {});
+        MachineInstruction();
+
+        Opcode getOpcode() const;
+        std::vector<Operand>& getOperands();
+        const std::vector<Operand>& getOperands() const;
+
+        void setOpcode(Opcode opcode);
+        void setOperands(std::vector<Operand> operands);
+
+        // returns the registers read, the implicit ones too
+        std::vector<Register::Knd> getUses() const;
+        // returns the registers written, the implicit ones too
+        std::vector<Register::Knd> getDefs() const;
+        // returns true if the destination register is replaced
+        // as a whole without being read
+        bool overwrites() const;
+        // returns true if the instruction sets the flags
+        bool writesFlags() const;
+        // returns true if the control flow or the stack changes, nothing
+        // is moved across it: labels, calls, jumps, pushes and pops. The
+        // string copies too since their memory is not an operand, and
+        // `vzeroupper` that changes every ymm register
+        bool isBarrier() const;
+
+        std::string toString() const;
+
+      private:
+        Opcode opcode;
+        std::vector<Operand> operands;
+    };
+
+    class MachineFunction {
+      public:
+        MachineFunction(std::string name);
+        MachineFunction();
+
+        const std::string& getName() const;
+        std::vector<MachineInstruction>& getInstructions();
+        const std::vector<MachineInstruction>& getInstructions() const;
+
+        void setName(std::string name);
+        void setInstructions(std::vector<MachineInstruction> instructions);
+
+        std::string toString() const;
+
+      private:
+        std::string name;
+        std::vector<MachineInstruction> instructions;
+    };
+  }
+}
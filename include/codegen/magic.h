@@ -0,0 +1,24 @@
+#pragma once
+
+#include "stl.h"
+
+namespace soft {
+  namespace codegen {
+    // the constants used to replace a division by a constant with a
+    // multiplication and a shift (Hacker's Delight, chapter 10)
+    struct SignedMagic {
+      int64_t multiplier;
+      size_t shift;
+    };
+    struct UnsignedMagic {
+      uint64_t multiplier;
+      size_t shift;
+      bool add; // the multiplier needs `bitwidth + 1` bits
+    };
+
+    // NOTE: the divisor must not be 0, 1, -1 or a power of 2,
+    // and the bitwidth is either 32 or 64
+    SignedMagic signed_magic(int64_t divisor, size_t bitwidth);
+    UnsignedMagic unsigned_magic(uint64_t divisor, size_t bitwidth);
+  }
+}
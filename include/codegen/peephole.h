@@ -0,0 +1,15 @@
+#pragma once
+
+#include "stl.h"
+#include "codegen/machine.h"
+
+namespace soft {
+  namespace codegen {
+    // rewrites the machine code one window at a time: removes the
+    // moves that don't change anything, the zero extensions of registers
+    // whose upper half is already clear and the constants loaded twice,
+    // folds the loads into the instruction that reads them, merges the
+    // shifts and additions into `lea` and zeroes the registers with `xor`
+    void peephole(MachineFunction& fn);
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "stl.h"
+#include "ir/Program.h"
+#include "codegen/Storage.h"
+
+namespace soft {
+  namespace codegen {
+    // the instructions where a temporary holds a value, the
+    // terminator counts as the instruction after the body
+    struct Interval {
+      Slot slot;
+      size_t start;
+      size_t end;
+      // the instructions that read the temporary
+      std::vector<size_t> uses;
+      // the first slot operand of the defining instruction,
+      // sharing its register saves a move
+      std::optional<size_t> hint;
+      // the register a parameter arrives in
+      std::optional<Register::Knd> incoming;
+    };
+
+    // returns the register that passes every argument of the given
+    // types (SysV), empty for the ones passed on the stack
+    std::vector<std::optional<Register::Knd>> argument_registers(const std::vector<Type>& types);
+
+    // NOTE: variables live in memory, only the temporaries and the parameters
+    // passed in registers that are never stored to get intervals, the
+    // parameters come first and are defined before the first instruction
+    std::vector<Interval> live_intervals(const Function& fn);
+
+    // returns true if the array is initialized with `rep movsb`, the
+    // smaller ones are copied one vector register at a time, it only
+    // pays off past its startup cost
+    bool uses_rep_movsb(const InitArray& init);
+    // returns the registers that the instruction overwrites, values that
+    // are live across it can't be kept in them
+    std::vector<Register::Knd> clobbers(const Instruction& instruction);
+
+    // assigns a register, or a stack slot if they're all taken, to every
+    // interval, the stack slots get their offset from `layout_frame()`.
+    // %rbp is allocated too unless `frame_pointer` is set
+    std::unordered_map<size_t, Storage> linear_scan(const Function& fn, const std::vector<Interval>& intervals, bool frame_pointer);
+    // same as `linear_scan()` but colors the interference graph (Chaitin-Briggs),
+    // coalescing the temporaries that would otherwise need a move, slower but
+    // leaves fewer moves and spills, used for `-O2`
+    std::unordered_map<size_t, Storage> graph_coloring(const Function& fn, const std::vector<Interval>& intervals, bool frame_pointer);
+  }
+}
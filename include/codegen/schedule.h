@@ -0,0 +1,14 @@
+#pragma once
+
+#include "stl.h"
+#include "opts.h"
+#include "codegen/machine.h"
+
+namespace soft {
+  namespace codegen {
+    // reorders the instructions between two barriers (list scheduling) so
+    // that the independent ones run while the slow ones wait for their
+    // result, the latencies are the ones of `cpu`
+    void schedule(MachineFunction& fn, Cpu cpu);
+  }
+}
@@ -1,12 +1,18 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 
 namespace soft {
   class Type {
     public:
-      enum class Knd { Integer, Float, Void };
+      enum class Knd { Integer, Float, Void, Array, Vector };
       Type(Knd knd, size_t bitwidth, bool signd = true);
+      // an array of `length` elements stored next to each other
+      Type(Type element, size_t length);
+      // an array or a vector of `length` elements, the vectors are the
+      // SIMD registers and only hold integers and floating points
+      Type(Knd knd, Type element, size_t length);
       Type();
 
       // returns true if the integer value is signed
@@ -24,23 +30,40 @@ namespace soft {
       // returns true if it's a floating point with a specific bitwidth
       bool isFloatingPoint(size_t bitwidth) const;
 
+      // returns true if it's an array, the bitwidth is then
+      // the one of all the elements
+      bool isArray() const;
+      // returns true if it's a vector, one value of `length` lanes
+      // operated on at once
+      bool isVector() const;
+
       size_t getBitwidth() const;
       Knd getKnd() const;
       size_t getByteSize() const;
+      // the size for the scalars, the element size for the arrays and the
+      // vectors, the vectors are always loaded and stored unaligned
+      size_t getAlignment() const;
+      const Type& getElement() const;
+      size_t getLength() const;
 
       void setSigned(bool signd);
       void setBitwidth(size_t bitwidth);
       void setKnd(Knd knd);
+      void setElement(Type element);
+      void setLength(size_t length);
 
-      // return true if the type given has the same kind and bitwidth
+      // return true if the type given has the same kind and bitwidth,
+      // and the same element type for the arrays and the vectors
       bool cmpTo(const Type& type) const;
       // returns true if the bitwidth is equal to this object's bitwidth
       bool cmpBitwidth(const size_t bitwidth) const;
       // returns true if the knd is equal to this object's knd
       bool cmpKnd(const Knd knd) const;
     private:
-      Knd knd;
-      size_t bitwidth;
+      Knd knd = Knd::Void;
+      size_t bitwidth = 0;
       bool signd = true;
+      std::shared_ptr<const Type> element;
+      size_t length = 0;
   };
 }
@@ -5,20 +5,27 @@
 namespace soft {
   class Alloca {
     public:
-      Alloca(Type type, Slot dst);
+      // `global` binds the slot to the module global of that
+      // name instead of giving it a stack slot
+      Alloca(Type type, Slot dst, std::optional<std::string> global = std::nullopt);
+
+      bool isGlobal() const;
 
       Type& getType();
       Slot& getDst();
+      const std::string& getGlobal() const;
 
       const Type& getType() const;
       const Slot& getDst() const;
 
       void setType(Type type);
       void setDst(Slot dst);
+      void setGlobal(std::optional<std::string> global);
 
     private:
       Type type;
       Slot dst;
+      std::optional<std::string> global;
   };
   class Store {
     public:
@@ -56,7 +63,7 @@ namespace soft {
   };
   class BinOp {
     public:
-      enum class Op { Add, Sub, Mul, Div };
+      enum class Op { Add, Sub, Mul, Div, Mod };
       BinOp(Value lhs, Value rhs, Op op, Slot dst);
 
       Value& getLeft();
@@ -101,5 +108,134 @@ namespace soft {
       Slot dst;
       Op op;
   };
-  using Instruction = std::variant<Alloca, Store, Convert, BinOp, UnOp>;
+  class Call {
+    public:
+      Call(std::string name, std::vector<Value> args, Slot dst);
+
+      std::string& getName();
+      std::vector<Value>& getArgs();
+      Slot& getDst();
+
+      const std::string& getName() const;
+      const std::vector<Value>& getArgs() const;
+      const Slot& getDst() const;
+
+      void setName(std::string name);
+      void setArgs(std::vector<Value> args);
+      void setDst(Slot dst);
+
+    private:
+      std::string name;
+      std::vector<Value> args;
+      Slot dst;
+  };
+  // reads the element `index * stride + offset` of the array, the index
+  // is 64-bit. a vector `dst` reads its lanes from that element on.
+  // the stride and the offset are the constant arithmetic of the
+  // index that the addressing computes (see `opt::fold_addresses()`)
+  class LoadElement {
+    public:
+      LoadElement(Value array, Value index, Slot dst);
+
+      Value& getArray();
+      Value& getIndex();
+      Slot& getDst();
+      size_t getStride() const;
+      int64_t getOffset() const;
+
+      const Value& getArray() const;
+      const Value& getIndex() const;
+      const Slot& getDst() const;
+
+      void setArray(Value array);
+      void setIndex(Value index);
+      void setDst(Slot dst);
+      void setStride(size_t stride);
+      void setOffset(int64_t offset);
+
+    private:
+      Value array, index;
+      Slot dst;
+      size_t stride = 1;
+      int64_t offset = 0;
+  };
+  // writes the element `index * stride + offset` of the array `dst`,
+  // the other elements keep their value. a vector `src` writes one
+  // element per lane from there on
+  class StoreElement {
+    public:
+      StoreElement(Value src, Value index, Slot dst);
+
+      Value& getSrc();
+      Value& getIndex();
+      Slot& getDst();
+      size_t getStride() const;
+      int64_t getOffset() const;
+
+      const Value& getSrc() const;
+      const Value& getIndex() const;
+      const Slot& getDst() const;
+
+      void setSrc(Value src);
+      void setIndex(Value index);
+      void setDst(Slot dst);
+      void setStride(size_t stride);
+      void setOffset(int64_t offset);
+
+    private:
+      Value src, index;
+      Slot dst;
+      size_t stride = 1;
+      int64_t offset = 0;
+  };
+  // writes the whole array `dst` at once, one constant per element
+  class InitArray {
+    public:
+      InitArray(std::vector<Constant> elements, Slot dst);
+
+      std::vector<Constant>& getElements();
+      Slot& getDst();
+
+      const std::vector<Constant>& getElements() const;
+      const Slot& getDst() const;
+
+      void setElements(std::vector<Constant> elements);
+      void setDst(Slot dst);
+
+    private:
+      std::vector<Constant> elements;
+      Slot dst;
+  };
+  // reads the lanes of the vector `src` in another order, the lane `l`
+  // of `dst` is the lane `lanes[l]`. a scalar `dst` is the lane `lanes[0]`
+  class Shuffle {
+    public:
+      Shuffle(Value src, std::vector<size_t> lanes, Slot dst);
+
+      Value& getSrc();
+      std::vector<size_t>& getLanes();
+      Slot& getDst();
+
+      const Value& getSrc() const;
+      const std::vector<size_t>& getLanes() const;
+      const Slot& getDst() const;
+
+      void setSrc(Value src);
+      void setLanes(std::vector<size_t> lanes);
+      void setDst(Slot dst);
+
+    private:
+      Value src;
+      std::vector<size_t> lanes;
+      Slot dst;
+  };
+  using Instruction = std::variant<Alloca, Store, Convert, BinOp, UnOp, Call, LoadElement, StoreElement, InitArray, Shuffle>;
+
+  // returns the slot written by the instruction
+  Slot& getDestination(Instruction& instruction);
+  const Slot& getDestination(const Instruction& instruction);
+
+  // returns the values read by the instruction
+  std::vector<Value*> getOperands(Instruction& instruction);
+  std::vector<const Value*> getOperands(const Instruction& instruction);
 }
@@ -64,27 +64,32 @@ namespace soft {
       size_t total_registers;
       bool defined;
   };
+  // returns the slots of the function bound to a module global
+  // and the name of the global, a call may read or write them
+  std::unordered_map<size_t, std::string> global_slots(const Function& fn);
+
   class Global {
     public:
-      Global(std::string name, Type type, Constant init);
+      // one constant per element for the arrays
+      Global(std::string name, Type type, std::vector<Constant> init);
       Global();
 
       std::string& getName();
       Type& getType();
-      Constant& getInit();
+      std::vector<Constant>& getInit();
 
       const std::string& getName() const;
       const Type& getType() const;
-      const Constant& getInit() const;
+      const std::vector<Constant>& getInit() const;
 
       void setName(std::string name);
       void setType(Type type);
-      void setInit(Constant init);
+      void setInit(std::vector<Constant> init);
 
     private:
       std::string name;
       Type type;
-      Constant init;
+      std::vector<Constant> init;
   };
   class Program {
     public:
@@ -5,6 +5,7 @@
 
 namespace soft {
   namespace ir {
+    Value generate_expr(const std::unique_ptr<ast::Expr>& expr);
     void generate_stmt(const std::unique_ptr<ast::Stmt>& stmt);
     Program generate(const std::vector<std::unique_ptr<ast::Stmt>>& ast, std::string program_name);
   }
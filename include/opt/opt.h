@@ -0,0 +1,94 @@
+#pragma once
+
+#include "ir/Program.h"
+#include "opts.h"
+
+namespace soft {
+  namespace opt {
+    // counters collected while optimizing, printed with `--stats`
+    struct Stats {
+      size_t removed_instructions;
+      size_t reused_expressions;
+      size_t folded_instructions;
+      size_t reduced_operations;
+      size_t propagated_copies;
+      size_t inlined_calls;
+      size_t vectorized_operations;
+      size_t folded_addresses;
+      size_t narrowed_operations;
+    };
+
+    // the values an integer may hold, both ends included
+    struct Range {
+      int64_t lo;
+      int64_t hi;
+    };
+
+    // truncates the value to the bitwidth of the type, then sign
+    // or zero extends it back depending on the type signedness
+    int64_t wrap(uint64_t value, const Type& type);
+    // converts the constant to the given type, the same way
+    // a `Convert` instruction would at runtime
+    Constant fold_cast(const Constant& constant, const Type& type);
+    // evaluates the operation on constants in the given type
+    // Returns: std::nullopt if it can't be evaluated at compile time
+    std::optional<Constant> fold(BinOp::Op op, const Constant& lhs, const Constant& rhs, const Type& type);
+    std::optional<Constant> fold(UnOp::Op op, const Constant& operand, const Type& type);
+
+
+    // removes the instructions whose result is never read and the
+    // stores that are overwritten (or never read) before the function returns
+    // Returns: the number of removed instructions
+    size_t dead_code_elimination(Function& fn);
+    // reuses the result of an earlier identical `BinOp`, `UnOp` or `Convert`
+    // instead of computing it again
+    // Returns: the number of removed instructions
+    size_t value_numbering(Function& fn);
+    // tracks the constants held by slots through stores, conversions and
+    // operations, replaces the reads with the constant and folds the
+    // instructions whose operands are all known
+    // Returns: the number of folded instructions
+    size_t constant_propagation(Function& fn);
+    // replaces the reads of a variable by the slot last stored to it,
+    // collapses the `Convert` chains that don't need the intermediate
+    // type and removes the ones that convert back to the original type
+    // Returns: the number of rewritten reads and conversions
+    size_t copy_propagation(Function& fn);
+    // removes the identity multiplications and divisions, turns the float
+    // divisions by a power of two into multiplications by its reciprocal
+    // and moves the multiplication constants to the right, where codegen
+    // selects shifts, `lea` and multiply-high sequences
+    // Returns: the number of rewritten instructions
+    size_t strength_reduction(Function& fn);
+    // packs the stores of `a[i + l] op b[j + l]` to consecutive elements
+    // `dst[k + l]` into one vector operation of the widest registers the
+    // target has (SLP, there are no loops to vectorize)
+    // Returns: the number of vector operations
+    size_t vectorize(Function& fn, Arch arch);
+    // moves the constant additions and multiplications of the array
+    // indices into the element accesses, where they are the displacement
+    // and the scale of the x86 address (the strength reduction of the
+    // induction variables, without the loops)
+    // Returns: the number of rewritten accesses
+    size_t fold_addresses(Function& fn);
+    // computes the range of the integer temporaries from the constants
+    // and the operations, the ones missing can hold any value of their
+    // type, enough to tell an array index is in bounds too
+    std::unordered_map<size_t, Range> value_ranges(const Function& fn);
+    // runs the 64-bit operations whose operands and result fit in 32 bits
+    // at 32 bits and extends the result once, zero extends the values that
+    // are never negative and divides them unsigned, which `movl` and the
+    // shifts do for free
+    // Returns: the number of rewritten instructions
+    size_t narrow_operations(Function& fn);
+
+    // replaces the calls to small functions by their body, the cost of a
+    // call is the callee instruction count minus the instructions that read
+    // a parameter given a constant, since they get folded afterwards
+    // Returns: the number of inlined calls
+    size_t inline_calls(Program& program, size_t threshold);
+
+    Stats optimize(Program& program, const Opts& opts);
+    void print_stats(const Stats& stats);
+  }
+}
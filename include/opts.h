@@ -1,6 +1,11 @@
 #pragma once
 
 namespace soft {
+  // the CPUs `-mtune` knows
+  enum class Cpu { Generic, Haswell, Skylake, Znver3 };
+  // the instruction sets `-march` enables (the x86-64 psABI levels)
+  enum class Arch { X86_64, X86_64_V2, X86_64_V3, X86_64_V4 };
+
   struct Opts {
     char* program;
     char* input_file;
@@ -10,6 +15,14 @@ namespace soft {
     bool just_compile; // don't link
     bool save_temps; // save .s and .o files
     bool help; // print help and exit
+    bool stats; // print optimization statistics
+
+    int opt_level; // -O0, -O1, -O2
+    size_t inline_threshold; // the biggest function inlined, in IR instructions
+    size_t unroll; // the vector moves an array copy loop does per iteration
+    Cpu tune; // the CPU the instructions are scheduled for
+    Arch arch; // the instructions the code may use
+    bool fp_contract; // fuse `a * b + c` into an FMA, changes the rounding
   };
 
   Opts parse_opts(int argc, char* argv[]);
@@ -19,6 +19,7 @@ namespace soft {
     struct AssgnOp;
     struct BinOp;
     struct UnOp;
+    struct Index;
 
     struct Return;
     struct Expmt;
@@ -31,7 +32,7 @@ namespace soft {
                               std::unique_ptr<ArrLit>, std::unique_ptr<Identifier>,
                               std::unique_ptr<VarDecl>, std::unique_ptr<FnCall>,
                               std::unique_ptr<AssgnOp>, std::unique_ptr<BinOp>,
-                              std::unique_ptr<UnOp>>;
+                              std::unique_ptr<UnOp>, std::unique_ptr<Index>>;
 
     using Stmt = std::variant<std::unique_ptr<Return>, std::unique_ptr<Expmt>,
                               std::unique_ptr<FnDecl>, std::unique_ptr<FnDef>>;
@@ -77,6 +78,11 @@ namespace soft {
       std::unique_ptr<Expr> oprand;
       Token::Knd op;
     };
+    // array[index]
+    struct Index {
+      std::unique_ptr<Expr> array;
+      std::unique_ptr<Expr> index;
+    };
 
     struct Return {
       std::unique_ptr<Expr> expr;
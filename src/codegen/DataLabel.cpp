@@ -1,5 +1,6 @@
 #include "codegen/DataLabel.h"
 #include "common.h"
+#include <bit>
 
 namespace soft {
   namespace codegen {
@@ -31,13 +32,15 @@ namespace soft {
 
         result += std::format(" {}", this->value.getIntegerValue());
       }
+      // the bits, the assembler can't spell -0.0 or a NaN payload
       else // if (type.isFloatingPoint())
       {
-        if (type.getBitwidth() == 32) result += ".float";
-        else if (type.getBitwidth() == 64) result += ".double";
+        double value = this->value.getFloatValue();
+        if (type.getBitwidth() == 32) result += std::format(".long {:#x}", std::bit_cast<uint32_t>((float) value));
+        else if (type.getBitwidth() == 64) result += std::format(".quad {:#x}", std::bit_cast<uint64_t>(value));
         else unreachable();
 
-        result += std::format(" {}", this->value.getFloatValue());
+        result += std::format(" # {}", value);
       }
 
       result += '\n';
@@ -3,18 +3,48 @@
 
 namespace soft {
   namespace codegen {
-    Memory::Memory(Type type, size_t offset)
-      : type(std::move(type)), offset(offset) {}
+    Memory::Memory(Type type, off_t offset, Register::Knd base)
+      : type(std::move(type)), offset(offset), base(base) {}
+    Memory::Memory(Type type, off_t offset, Register::Knd base, Register::Knd index, size_t scale)
+      : type(std::move(type)), offset(offset), base(base), index(index), scale(scale) {}
+    Memory::Memory(Type type, std::string symbol)
+      : type(std::move(type)), offset(0), base(Register::Knd::RAX), symbol(std::move(symbol)) {}
     Memory::Memory() = default;
 
     Type& Memory::getType() { return this->type; }
     const Type& Memory::getType() const { return this->type; }
-    size_t Memory::getOffset() const { return this->offset; }
+    off_t Memory::getOffset() const { return this->offset; }
+    Register::Knd Memory::getBase() const { return this->base; }
+    std::optional<Register::Knd> Memory::getIndex() const { return this->index; }
+    size_t Memory::getScale() const { return this->scale; }
+    const std::optional<std::string>& Memory::getSymbol() const { return this->symbol; }
 
     void Memory::setType(Type type) { this->type = std::move(type); }
-    void Memory::setOffset(size_t offset) { this->offset = offset; }
+    void Memory::setOffset(off_t offset) { this->offset = offset; }
+    void Memory::setBase(Register::Knd base) { this->base = base; }
+    void Memory::setIndex(std::optional<Register::Knd> index) { this->index = index; }
+    void Memory::setScale(size_t scale) { this->scale = scale; }
+    void Memory::setSymbol(std::optional<std::string> symbol) { this->symbol = std::move(symbol); }
 
-    std::string Memory::toString() const { return std::format("-{}(%rbp)", this->offset);}
+    std::string Memory::toString() const
+    {
+      if (this->symbol.has_value())
+        return this->offset == 0 ? std::format("{}(%rip)", *this->symbol) : std::format("{}+{}(%rip)", *this->symbol, this->offset);
+
+      Register base(Type(Type::Knd::Integer, 64), this->base);
+      std::string address = base.toString();
+      if (this->index.has_value())
+      {
+        address += ", " + Register(Type(Type::Knd::Integer, 64), *this->index).toString();
+        if (this->scale > 1)
+          address += std::format(", {}", this->scale);
+      }
+
+      if (this->offset == 0)
+        return std::format("({})", address);
+
+      return std::format("{}({})", this->offset, address);
+    }
 
     Register::Register(Type type, Knd knd)
       : type(std::move(type)), knd(knd) {}
@@ -27,19 +57,36 @@ namespace soft {
     void Register::setType(Type type) { this->type = std::move(type); }
     void Register::setKnd(Knd knd) { this->knd = knd; }
 
+    bool Register::isCalleeSaved() const
+    {
+      switch (this->knd)
+      {
+        case Knd::RBX: case Knd::R12: case Knd::R13:
+        case Knd::R14: case Knd::R15: case Knd::RBP:
+        case Knd::RSP:
+          return true;
+        default:
+          return false;
+      }
+    }
+
     std::string Register::toString() const 
     {
-      static constexpr std::array<std::string, 9> gpr64 = {
-        "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"
+      static constexpr std::array<std::string, 16> gpr64 = {
+        "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11",
+        "rbx", "r12", "r13", "r14", "r15", "rbp", "rsp"
       };
-      static constexpr std::array<std::string, 9> gpr32 = {
-        "eax", "ecx", "edx", "esi", "edi", "r8d", "r9d", "r10d", "r11d"
+      static constexpr std::array<std::string, 16> gpr32 = {
+        "eax", "ecx", "edx", "esi", "edi", "r8d", "r9d", "r10d", "r11d",
+        "ebx", "r12d", "r13d", "r14d", "r15d", "ebp", "esp"
       };
-      static constexpr std::array<std::string, 9> gpr16 = {
-        "ax", "cx", "dx", "si", "di", "r8w", "r9w", "r10w", "r11w"
+      static constexpr std::array<std::string, 16> gpr16 = {
+        "ax", "cx", "dx", "si", "di", "r8w", "r9w", "r10w", "r11w",
+        "bx", "r12w", "r13w", "r14w", "r15w", "bp", "sp"
       };
-      static constexpr std::array<std::string, 9> gpr8 = {
-        "al", "cl", "dl", "sil", "dil", "r8b", "r9b", "r10b", "r11b"
+      static constexpr std::array<std::string, 16> gpr8 = {
+        "al", "cl", "dl", "sil", "dil", "r8b", "r9b", "r10b", "r11b",
+        "bl", "r12b", "r13b", "r14b", "r15b", "bpl", "spl"
       };
       static constexpr std::array<std::string, 16> xmms = {
         "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6",
@@ -48,8 +95,11 @@ namespace soft {
       };
 
       size_t index = static_cast<int>(this->knd);
-      if (index >= 9)
-        return "%" + xmms[index - 9];
+      // the 32-byte vectors are the whole ymm register
+      if (index >= gpr64.size() && this->type.getByteSize() == 32)
+        return "%y" + xmms[index - gpr64.size()].substr(1);
+      if (index >= gpr64.size())
+        return "%" + xmms[index - gpr64.size()];
 
       switch (this->type.getByteSize())
       {
@@ -99,5 +149,10 @@ namespace soft {
       if (isRegister()) return this->getRegister().toString();
       else return this->getMemory().toString();
     }
+
+    bool uses_xmm(const Type& type)
+    {
+      return type.isFloatingPoint() || type.isVector();
+    }
   }
 }
@@ -2,18 +2,27 @@
 #include "codegen/codegen.h"
 #include "codegen/Storage.h"
 #include "codegen/DataLabel.h"
+#include "codegen/magic.h"
+#include "codegen/regalloc.h"
+#include "codegen/frame.h"
+#include "codegen/peephole.h"
+#include "codegen/machine.h"
+#include "codegen/schedule.h"
 #include <cassert>
+#include <unordered_set>
 
 #define appendln(fmt, ...) out += std::format(fmt "\n" __VA_OPT__(,) __VA_ARGS__) 
 #define append(fmt, ...) out += std::format(fmt __VA_OPT__(,) __VA_ARGS__) 
 
 namespace soft {
   namespace codegen {
+    using Opcode = MachineInstruction::Opcode;
+
     // to track reserved and unreserved registers
     // NOTE: the order is crucial since we access them by
     // the int value of the enum class Type::Knd which is equal
     // to the index of it's value in this array.
-    std::array<std::pair<Register::Knd, bool>, 25> pool = {{
+    std::array<std::pair<Register::Knd, bool>, 32> pool = {{
       {Register::Knd::RAX  , false},
       {Register::Knd::RCX  , false},
       {Register::Knd::RDX  , false},
@@ -23,6 +32,13 @@ namespace soft {
       {Register::Knd::R9   , false},
       {Register::Knd::R10  , false},
       {Register::Knd::R11  , false},
+      {Register::Knd::RBX  , false},
+      {Register::Knd::R12  , false},
+      {Register::Knd::R13  , false},
+      {Register::Knd::R14  , false},
+      {Register::Knd::R15  , false},
+      {Register::Knd::RBP  , false},
+      {Register::Knd::RSP  , false},
 
       {Register::Knd::XMM0 , false},
       {Register::Knd::XMM1 , false},
@@ -44,12 +60,38 @@ namespace soft {
 
     std::unordered_map<size_t, Storage> storage;
 
+    // the live intervals of the current function temporaries
+    std::vector<Interval> intervals;
+    // the callee-saved registers used by the current function
+    // and where the prologue saved them
+    std::vector<std::pair<Register, Memory>> saved;
+
+    // the floating point constants of the whole program, keyed by their
+    // bits so -0.0 and the NaNs get their own
     std::vector<DataLabel> labels;
-    std::unordered_map<double, size_t> double_labels;
-    std::unordered_map<float, size_t> float_labels;
+    std::unordered_map<uint64_t, size_t> double_labels;
+    std::unordered_map<uint32_t, size_t> float_labels;
+    // the elements of the array literals, keyed by their data
+    std::vector<DataLabel> arrays;
+    std::unordered_map<std::string, size_t> array_labels;
 
     std::string out;
-    size_t offset;
+    // the function being generated
+    MachineFunction machine;
+    // the functions with a body in this program
+    std::unordered_set<std::string> defined;
+    // false when the function addresses its frame through %rsp,
+    // %rbp is a general register then
+    bool frame_pointer;
+    // the function uses the ymm registers, see `clear_upper()`
+    bool ymm;
+    // the array copies unrolled, the ones that need a loop are
+    // counted apart and number its label. Printed with `--stats`
+    size_t unrolled_copies;
+    size_t copy_loops;
+    // the bytes the prologue subtracts from %rsp
+    size_t stack_size;
+    Opts options;
 
     bool isRegister(const Value& v)
     {
@@ -85,27 +127,9 @@ namespace soft {
     {
       pool[static_cast<int>(register_v.getKnd())].second = false;
     }
-    char suffix(const Type& type)
+    void emit(Opcode opcode, std::vector<Operand> operands = {})
     {
-      if (type.isFloatingPoint())
-      {
-        switch (type.getByteSize())
-        {
-          case 4: return 's';
-          case 8: return 'd';
-        }
-      }
-      else
-      {
-        switch (type.getByteSize())
-        {
-          case 1: return 'b';
-          case 2: return 'w';
-          case 4: return 'l';
-          case 8: return 'q';
-        }
-      }
-      unreachable();
+      machine.getInstructions().push_back(MachineInstruction(opcode, std::move(operands)));
     }
 
     DataLabel floating_point_label(const Constant& constant)
@@ -113,12 +137,12 @@ namespace soft {
       // float
       if (constant.getType().isFloatingPoint(32))
       {
-        float value = (double) constant.getFloatValue();
+        uint32_t value = std::bit_cast<uint32_t>((float) constant.getFloatValue());
 
         if (auto it = float_labels.find(value); it != float_labels.end())
           return labels[it->second];
 
-        DataLabel label(std::format(".F32N{}", float_labels.size()), {Data(constant)});
+        DataLabel label(std::format(".LF32N{}", float_labels.size()), {Data(constant)});
         labels.push_back(label);
         float_labels[value] = labels.size() - 1;
         return label;
@@ -126,109 +150,215 @@ namespace soft {
       // double
       else if (constant.getType().isFloatingPoint(64))
       {
-        double value = constant.getFloatValue();
+        uint64_t value = std::bit_cast<uint64_t>((double) constant.getFloatValue());
 
         if (auto it = double_labels.find(value); it != double_labels.end())
           return labels[it->second];
 
-        DataLabel label(std::format(".F64N{}", double_labels.size()), {Data(constant)});
+        DataLabel label(std::format(".LF64N{}", double_labels.size()), {Data(constant)});
         labels.push_back(label);
         double_labels[value] = labels.size() - 1;
         return label;
       }
       unreachable();
     }
-    // to string functions
-    std::string movts(const Type& type)
-    {
-      std::string mov = "mov";
-      if (type.isFloatingPoint())
-        mov += 's';
-
-      mov += suffix(type);
-      return mov;
-    }
-    std::string constantts(const Constant& constant)
+    // the operand that reads the value
+    Operand operand(const Constant& constant)
     {
       if (constant.isIntegerValue())
-        return std::format("${}", constant.getIntegerValue());
+        return Immediate(constant.getIntegerValue());
 
       else if (constant.isFloatValue())
       {
         DataLabel label = floating_point_label(constant);
-        return std::format("{}(%rip)", label.getName());
+        return Symbol(constant.getType(), label.getName());
       }
 
       unreachable();
     }
-    std::string valuets(const Value& value)
+    Operand operand(const Value& value)
     {
       if (value.isConstant())
-        return constantts(value.getConstant());
+        return operand(value.getConstant());
       else if (value.isSlot())
-        return storage[value.getSlot().getId()].toString();
+        return storage[value.getSlot().getId()];
 
       unreachable();
     }
 
-    Storage make_temp(const Type& type)
+    // returns a free register of the type's class, the registers of the
+    // values used around the current instruction are reserved by `reserve()`
+    Register allocate_register(const Type& type)
     {
-      static constexpr size_t integer_register_size = 9;
-      static constexpr size_t float_register_size = 15;
+      static constexpr size_t integer_register_size = 16;
+      static constexpr size_t float_register_size = 16;
 
       assert(!type.isVoid());
-      size_t start = type.isFloatingPoint() ? integer_register_size : 0;
-      size_t end = type.isFloatingPoint() ? float_register_size : integer_register_size;
+      size_t start = uses_xmm(type) ? integer_register_size : 0;
+      size_t end = uses_xmm(type) ? integer_register_size + float_register_size : integer_register_size;
 
       for (size_t i = start; i < end; ++i)
       {
         if (!pool[i].second) // not reserved
         {
-          return Storage( Register(type, pool[i].first) );
+          pool[i].second = true;
+          return Register(type, pool[i].first);
         }
       }
 
-      // if there's no free registers
-      // fallback to memory
-      offset += type.getByteSize();
-      return Storage( Memory(type, offset) );
+      // can't happen, the scratch registers are never allocated
+      unreachable();
     }
-    Register allocate_register(const Type& type)
+    // allocates a register that is not one of `except`
+    Register allocate_register(const Type& type, std::initializer_list<Register::Knd> except)
     {
-      static constexpr size_t integer_register_size = 9;
-      static constexpr size_t float_register_size = 15;
-
-      assert(!type.isVoid());
-      size_t start = type.isFloatingPoint() ? integer_register_size : 0;
-      size_t end = type.isFloatingPoint() ? float_register_size : integer_register_size;
-
-      for (size_t i = start; i < end; ++i)
+      // reserve them while searching
+      std::vector<size_t> reserved;
+      for (Register::Knd knd : except)
       {
-        if (!pool[i].second) // not reserved
+        size_t index = static_cast<int>(knd);
+        if (!pool[index].second)
         {
-          pool[i].second = true;
-          return Register(type, pool[i].first);
+          pool[index].second = true;
+          reserved.push_back(index);
         }
       }
 
-      // I don't know
-      todo();
+      Register reg = allocate_register(type);
+
+      for (size_t index : reserved)
+        pool[index].second = false;
+
+      return reg;
+    }
+    // reserves the registers of the values that are read, written
+    // or live across the instruction at `position`, and the callee-saved
+    // registers the prologue didn't save
+    void reserve(size_t position)
+    {
+      for (auto& reg : pool)
+      {
+        Register knd(Type(), reg.first);
+        reg.second = knd.isCalleeSaved() && std::none_of(saved.begin(), saved.end(), [&](const auto& save) {
+          return save.first.getKnd() == reg.first;
+        });
+      }
+
+      for (const Interval& interval : intervals)
+      {
+        if (interval.start > position || interval.end < position)
+          continue;
+
+        const Storage& stored = storage[interval.slot.getId()];
+        if (stored.isRegister())
+          pool[static_cast<int>(stored.getRegister().getKnd())].second = true;
+      }
     }
     void load_constant(const Constant& constant, const Register& dst)
     {
-      appendln("  {} {}, {}", movts(dst.getType()), constantts(constant), dst.toString());
+      emit(Opcode::Mov, { operand(constant), dst });
     }
     void load_register(const Register& reg, const Register& dst)
     {
-      appendln("  {} {}, {}", movts(dst.getType()), reg.toString(), dst.toString());
+      emit(Opcode::Mov, { reg, dst });
     }
     void load_memory(const Memory& mem, const Register& dst)
     {
-      appendln("  {} {}, {}", movts(dst.getType()), mem.toString(), dst.toString());
+      emit(Opcode::Mov, { mem, dst });
+    }
+    bool fits_imm32(int64_t value)
+    {
+      return value >= INT32_MIN && value <= INT32_MAX;
+    }
+    // returns true if `v` is held by the register `reg`
+    bool aliases(const Value& v, const Register& reg)
+    {
+      return isRegister(v) && getRegister(v).getKnd() == reg.getKnd();
+    }
+    // loads the integer `v` into `dst`, sign or zero extending it
+    // to the width of `dst`
+    void load_integer(const Value& v, const Register& dst)
+    {
+      const Type& sty = v.getType();
+      const Type& dty = dst.getType();
+
+      if (v.isConstant())
+      {
+        int64_t value = v.getConstant().getIntegerValue();
+        if (dty.getBitwidth() == 64 && !fits_imm32(value))
+          emit(Opcode::Movabs, { Immediate(value), dst });
+        else
+          emit(Opcode::Mov, { Immediate(value), dst });
+        return;
+      }
+
+      Operand src = operand(v);
+      if (sty.getBitwidth() == dty.getBitwidth())
+      {
+        if (!aliases(v, dst))
+          emit(Opcode::Mov, { src, dst });
+        return;
+      }
+
+      // 32 -> 64 zero extension is implicit
+      if (sty.getBitwidth() == 32 && !sty.isSigned())
+      {
+        Register low = dst;
+        low.getType().setBitwidth(32);
+        emit(Opcode::Mov, { src, low });
+        return;
+      }
+
+      emit(sty.isSigned() ? Opcode::Movsx : Opcode::Movzx, { src, dst });
+    }
+    // loads `v` into `dst` if it's not already there
+    void load(const Value& v, const Register& dst)
+    {
+      if (dst.getType().isInteger())
+        return load_integer(v, dst);
+
+      if (v.isConstant())
+        load_constant(v.getConstant(), dst);
+      else if (isMemory(v))
+        load_memory(getMemory(v), dst);
+      else if (!aliases(v, dst))
+        load_register(getRegister(v), dst);
+    }
+    // returns `v` in a form that can be the source operand of an
+    // instruction, the integers that don't fit in 32 bits are loaded
+    Operand source(const Value& v)
+    {
+      if (v.isConstant() && v.getType().isInteger(64) && !fits_imm32(v.getConstant().getIntegerValue()))
+      {
+        Register tmp = allocate_register(v.getType());
+        load_integer(v, tmp);
+        return tmp;
+      }
+
+      return operand(v);
+    }
+    // returns the register the result of the current instruction is
+    // computed in, a temporary one if `dst` is spilled
+    Register target(const Slot& dst)
+    {
+      const Storage& stored = storage[dst.getId()];
+      if (stored.isRegister())
+        return stored.getRegister();
+
+      return allocate_register(dst.getType());
+    }
+    // moves the result computed in `reg` to where `dst` lives
+    void place(const Slot& dst, Register reg)
+    {
+      const Storage& stored = storage[dst.getId()];
+      reg.setType(dst.getType());
+
+      if (stored.isMemory())
+        emit(Opcode::Mov, { reg, stored });
+      else if (stored.getRegister().getKnd() != reg.getKnd())
+        load_register(reg, stored.getRegister());
     }
 
-    // NOTE: `Constant` source values are not allowed and should
-    // be handled in the IR phase
     void int2int(Slot& src, Slot& dst)
     {
       Type& sty = src.getType(); // src type
@@ -237,59 +367,24 @@ namespace soft {
       if (!sty.isInteger() || !dty.isInteger())
         return;
 
-      if (dty.cmpTo(sty))
-        return;
-
+      Register result = target(dst);
 
-      // the source storage
-      // WARN: we assume there's only a `Constant` and a `Slot`
-      // possibilities for the `Value`
-      Storage& ss = storage[src.getId()];
-
-      // in this case if the src is a variable in `Memory` we should load
-      // it into a register of the same size(bitwidth) and change the bitwidth
-      // of the `dst` to match the given destination type bitwidth, so it will
-      // be used in the next instruction with that new size
-      if (sty.getBitwidth() > dty.getBitwidth())
+      // truncation: the low part of the source is the result
+      if (sty.getBitwidth() >= dty.getBitwidth())
       {
-        Storage ds;
-        if (ss.isMemory())
-        {
-          ds = allocate_register(sty);
-          appendln("  {} {}, {}", movts(sty), ss.toString(), ds.toString());
-        }
-        else // if (ss.isRegister())
-        {
-          ds = ss;
-        }
+        Storage ss = storage[src.getId()]; // src storage
+        ss.getType().setBitwidth(dty.getBitwidth());
 
-        ds.getType().setBitwidth(dty.getBitwidth());
-        storage[dst.getId()] = ds;
+        if (!ss.isRegister() || ss.getRegister().getKnd() != result.getKnd())
+          emit(Opcode::Mov, { ss, result });
       }
+      // sign or zero extension
       else
       {
-        // mov[s|z][x][x]
-        std::string mov = "mov";
-        if (ss.getType().isSigned()) mov += 's';
-        else mov += 'z';
-        mov += suffix(sty);
-        mov += suffix(dty);
-
-        Storage ds;
-        if (ss.isMemory())
-        {
-          ds = allocate_register(dty);
-          appendln("  {} {}, {}", mov, ss.toString(), ds.toString());
-        }
-        else // if (ss.isRegister())
-        {
-          ds = ss;
-          ds.getType().setBitwidth(dty.getBitwidth());
-          appendln("  {} {}, {}", mov, ss.toString(), ds.toString());
-        }
-
-        storage[dst.getId()] = ds;
+        load_integer(Value(src), result);
       }
+
+      place(dst, result);
     }
     void int2float(Slot& src, Slot& dst)
     {
@@ -300,27 +395,24 @@ namespace soft {
         return;
 
       // since cvtsi2s[s|d]x requires a doubleword or a quad word source
-      if (sty.getBitwidth() < 32)
+      // and reads it as signed, unsigned doublewords are widened too
+      Type wide = sty;
+      wide.setBitwidth(std::max<size_t>(sty.getBitwidth(), 32));
+      if (!sty.isSigned() && sty.getBitwidth() == 32)
+        wide.setBitwidth(64);
+
+      Operand from = operand(Value(src));
+      if (wide.getBitwidth() != sty.getBitwidth())
       {
-        // make a temporary destination with an "Integer" type
-        // to pass it to `int2int_cast()` and re-assign it to the
-        // `src` to convert it to a floating point.
-        Slot tmp_dst = dst;
-        tmp_dst.setType(sty);
-        tmp_dst.getType().setBitwidth(32); // override the size
-
-        int2int(src, tmp_dst);
-        src = tmp_dst;
+        Register tmp = allocate_register(wide);
+        load_integer(Value(src), tmp);
+        from = tmp;
       }
 
       // cvtsi2s[s|d][l|q]
-      std::string cvt = std::format("cvtsi2s{}{}", suffix(dty), suffix(sty));
-
-      Storage ds = allocate_register(dty); // destination storage
-      Storage ss = storage[src.getId()]; // src storage
-      appendln("  {} {}, {}", cvt, ss.toString(), ds.toString());
-
-      storage[dst.getId()] = ds;
+      Register result = target(dst);
+      emit(Opcode::Cvtsi2s, { from, result });
+      place(dst, result);
     }
     void float2int(Slot& src, Slot& dst)
     {
@@ -330,21 +422,20 @@ namespace soft {
       if (!sty.isFloatingPoint() || !dty.isInteger())
         return;
 
-      size_t original_bitwidth = dty.getBitwidth();
-      if (dty.getBitwidth() < 32) // min
-        dty.setBitwidth(32);
-
-      Storage ss = storage[src.getId()]; // src storage
-      Storage ds = allocate_register(dty); // dst storage
+      // the conversion writes a doubleword or a quad word, and
+      // the unsigned doublewords need the 64-bit one
+      Type wide = dty;
+      wide.setBitwidth(std::max<size_t>(dty.getBitwidth(), 32));
+      if (!dty.isSigned() && dty.getBitwidth() == 32)
+        wide.setBitwidth(64);
 
-      std::string cvt = std::format("cvts{}2si", suffix(sty));
-      appendln("  {} {}, {}", cvt, ss.toString(), ds.toString());
+      Register result = target(dst);
+      result.setType(wide);
 
-      // restore original size
-      if (dty.getBitwidth() != original_bitwidth)
-        dty.setBitwidth(32);
+      // truncate toward zero like the constant folding does
+      emit(Opcode::Cvtts2si, { operand(Value(src)), result });
 
-      storage[dst.getId()] = ds;
+      place(dst, result);
     }
     void float2float(Slot& src, Slot& dst)
     {
@@ -354,331 +445,1036 @@ namespace soft {
       if (!sty.isFloatingPoint() || !dty.isFloatingPoint())
         return;
 
-      Storage ss = storage[src.getId()]; // src storage
-      Storage ds; // dst storage
+      Register result = target(dst);
+      emit(Opcode::Cvts2s, { operand(Value(src)), result });
+
+      place(dst, result);
+    }
+
+    // returns true if the code may use the VEX encoded instructions
+    bool avx()
+    {
+      return options.arch >= Arch::X86_64_V3;
+    }
+    // generates `dst = left op right` in the VEX three operand form,
+    // the operands stay where they are
+    void generate_vex(const BinOp& binop, Opcode op, bool commutative)
+    {
+      const Value* left = &binop.getLeft();
+      const Value* right = &binop.getRight();
+      const Slot& dst = binop.getDst();
+
+      // the first source has to be a register
+      if (commutative && !isRegister(*left) && isRegister(*right))
+        std::swap(left, right);
+
+      Register result = target(dst);
 
-      // reuse the same register
-      if (ss.isRegister())
+      Operand first;
+      if (isRegister(*left))
       {
-        ds = ss;
-        ds.getType().setBitwidth(dty.getBitwidth());
+        first = getRegister(*left);
       }
-      // allocate a new register
       else
       {
-        ds = allocate_register(dty);
+        Register reg = aliases(*right, result) ? allocate_register(result.getType()) : result;
+        load(*left, reg);
+        first = reg;
       }
 
-      std::string cvt = std::format("cvts{}2s{}", suffix(sty), suffix(dty));
-      appendln("  {} {}, {}", cvt, ss.toString(), ds.toString());
-
-      storage[dst.getId()] = ds;
+      emit(op, { operand(*right), first, result });
+      place(dst, result);
     }
-
-    void generate_instruction(Instruction& instruction)
+    // generates `dst = left op right` in the two operand form, the
+    // left operand is loaded in the destination first
+    void generate_binary(const BinOp& binop, Opcode op, bool commutative)
     {
-      switch (instruction.index())
-      {
-        case 0: // Alloca
-        {
-          const auto& alloca = std::get<0>(instruction);
-          offset += alloca.getType().getByteSize();
-
-          Memory mem(alloca.getType(), offset);
-          storage[alloca.getDst().getId()].setValue(mem);
-
-          return;
-        }
-        case 1: // Store
-        {
-          const auto& store = std::get<1>(instruction);
-          const auto& value = store.getSrc();
+      if (binop.getDst().getType().isFloatingPoint() && avx())
+        return generate_vex(binop, op, commutative);
 
-          std::optional<Storage> ss; // src storage
-          if (value.isSlot())
-          {
-            Storage stored = storage[value.getSlot().getId()];
-
-            if (stored.isMemory())
-            {
-              ss = allocate_register(store.getDst().getType());
-              load_memory(stored.getMemory(), ss->getRegister());
-            }
-            else // if (stored.isRegister())
-            {
-              ss = stored.getRegister();
-            }
-          }
-          else if (value.isConstant() && value.getType().isFloatingPoint())
-          {
-            ss = allocate_register(store.getDst().getType());
-            load_constant(value.getConstant(), ss->getRegister());
-          }
-
-          std::string mov = movts(store.getDst().getType());
-          std::string dst = storage[store.getDst().getId()].toString();
+      const Value* left = &binop.getLeft();
+      const Value* right = &binop.getRight();
+      const Slot& dst = binop.getDst();
 
-          std::string src;
-          if (ss.has_value()) src = ss->toString();
-          else src = valuets(value);
-          appendln("  {} {}, {}", mov, src, dst);
+      Register result = target(dst);
 
-          if (ss.has_value() && ss->isRegister())
-            deallocate(ss->getRegister());
+      // the destination may share the register of an operand read for
+      // the last time, make sure loading the left one doesn't overwrite it
+      if (commutative && aliases(*right, result) && !aliases(*left, result))
+        std::swap(left, right);
 
-          return;
-        }
-        case 2: // Convert
-        {
-          auto& convert = std::get<2>(instruction);
+      Operand src;
+      if (aliases(*right, result) && !aliases(*left, result))
+      {
+        Register copy = allocate_register(result.getType());
+        load(*right, copy);
+        src = copy;
+      }
+      else
+      {
+        src = source(*right);
+      }
 
-          if (!convert.getSrc().isSlot())
-          {
-            std::println("Error: the source should be a valid Slot when Casting");
-            exit(1);
-          }
+      load(*left, result);
+      emit(op, { src, result });
+      place(dst, result);
+    }
+    // generates the packed `dst = left op right`, the two operand SSE
+    // forms fault on unaligned memory so their source is a register
+    void generate_packed(const BinOp& binop)
+    {
+      Opcode op;
+      switch (binop.getOp())
+      {
+        case BinOp::Op::Add: op = Opcode::Add; break;
+        case BinOp::Op::Sub: op = Opcode::Sub; break;
+        case BinOp::Op::Mul: op = Opcode::Mul; break;
+        case BinOp::Op::Div: op = Opcode::Div; break;
+        default:             unreachable();
+      }
+      const bool commutative = op == Opcode::Add || op == Opcode::Mul;
 
-          Slot& src = convert.getSrc().getSlot();
-          Slot& dst = convert.getDst();
+      const Type& lane = binop.getDst().getType().getElement();
+      if (op == Opcode::Mul && lane.isInteger() && options.arch < Arch::X86_64_V2)
+      {
+        std::println("Multiplying integer vectors needs -march=x86-64-v2 or later (pmulld)");
+        exit(1);
+      }
 
-          const Type& sty = src.getType();
-          const Type& dty = dst.getType();
+      if (avx())
+        return generate_vex(binop, op, commutative);
 
-          // int to int
-          if (sty.isInteger() && dty.isInteger())
-            return int2int(src, dst);
+      const Value* left = &binop.getLeft();
+      const Value* right = &binop.getRight();
+      const Slot& dst = binop.getDst();
 
-          // int to float
-          else if (sty.isInteger() && dty.isFloatingPoint())
-            return int2float(src, dst);
+      Register result = target(dst);
+      if (commutative && aliases(*right, result) && !aliases(*left, result))
+        std::swap(left, right);
 
-          // float to int
-          else if (sty.isFloatingPoint() && dty.isInteger())
-            return float2int(src, dst);
+      Register src;
+      if (isRegister(*right) && (!aliases(*right, result) || aliases(*left, result)))
+      {
+        src = getRegister(*right);
+      }
+      else
+      {
+        src = allocate_register(result.getType());
+        load(*right, src);
+      }
 
-          // float to float
-          else if (sty.isFloatingPoint() && dty.isFloatingPoint())
-            return float2float(src, dst);
+      load(*left, result);
+      emit(op, { src, result });
+      place(dst, result);
+    }
+    void generate_mul(const BinOp& binop)
+    {
+      const Slot& dst = binop.getDst();
+      const Type& type = dst.getType();
 
-          // idk
-          else
-            unreachable();
-        }
-        case 3: // BinOp
-        {
-          const auto& binop = std::get<3>(instruction);
-          // NOTE: Constant, Constant case is handled in the IR
-          // `constant_folding`
-          switch (binop.getOp())
-          {
-            case BinOp::Op::Add:
-            {
-              const Value& left = binop.getLeft();
-              const Value& right = binop.getRight();
-              const Slot& dst = binop.getDst();
+      if (type.isFloatingPoint())
+        return generate_binary(binop, Opcode::Mul, true);
 
-              std::string src;
+      // keep the constant on the right
+      const Value* left = &binop.getLeft();
+      const Value* right = &binop.getRight();
+      if (left->isConstant())
+        std::swap(left, right);
 
-              // we need to load
-              if (left.isConstant() && isMemory(right))
-              {
-                const Memory& mem = getMemory(right);
-                Register dst_storage = allocate_register(mem.getType());
-                load_memory(mem, dst_storage);
+      if (!right->isConstant() && type.getBitwidth() >= 16)
+        return generate_binary(binop, Opcode::Imul, true);
 
-                storage[dst.getId()] = dst_storage;
-                src = constantts(left.getConstant());
-              }
-              else if (isMemory(left) && right.isConstant())
-              {
-                const Memory& mem = getMemory(left);
-                Register dst_storage = allocate_register(mem.getType());
-                load_memory(mem, dst_storage);
+      // the low bits of the product don't depend on the upper bits of
+      // the operands, so 8-bit values (no two operands `imul`) and `lea`
+      // can work on the 32-bit registers
+      Type wide = type;
+      if (wide.getBitwidth() < 32)
+        wide.setBitwidth(32);
 
-                storage[dst.getId()] = dst_storage;
-                src = constantts(right.getConstant());
-              }
-              else if (isMemory(left) && isMemory(right))
-              {
-                const Memory& mem = getMemory(left);
-                Register dst_storage = allocate_register(mem.getType());
-                load_memory(mem, dst_storage);
+      Register result = target(dst);
+      result.setType(wide);
 
-                storage[dst.getId()] = dst_storage;
-                src = getMemory(right).toString();
-              }
+      if (!right->isConstant())
+      {
+        if (aliases(*right, result))
+          std::swap(left, right);
 
-              // we may re-use an operation side register
-              if (isRegister(left) && isRegister(right))
-              {
-                // the right register is the destination
-                storage[dst.getId()] = getRegister(right);
+        load_integer(*left, result);
 
-                Register lr = getRegister(left);
-                // the left register is the source
-                src = lr.toString();
+        Register other;
+        if (isRegister(*right))
+        {
+          other = Register(wide, getRegister(*right).getKnd());
+        }
+        else
+        {
+          other = allocate_register(wide);
+          load_integer(*right, other);
+        }
 
-                // special case: deallocate the left register
-                deallocate(lr);
-              }
-              else if (isRegister(left) && isMemory(right))
-              {
-                // the left register is the destination
-                storage[dst.getId()] = getRegister(left);
-                // the right (memory) is the src
-                src = getMemory(right).toString();
-              }
-              else if (isRegister(left) && right.isConstant())
-              {
-                // the left register is the destination
-                storage[dst.getId()] = getRegister(left);
-                // the right (constant) is the src
-                src = constantts(right.getConstant());
-              }
-              else if (isMemory(left) && isRegister(right))
-              {
-                // the right register is the destination
-                storage[dst.getId()] = getRegister(right);
-                // the left (memory) is the source
-                src = getMemory(left).toString();
-              }
-              else if (left.isConstant() && isRegister(right))
-              {
-                // the right register is the destination
-                storage[dst.getId()] = getRegister(right);
-                // the left (constant) is the source
-                src = constantts(left.getConstant());
-              }
+        emit(Opcode::Imul, { other, result });
+        return place(dst, result);
+      }
 
-              std::string add = "add";
-              if (dst.getType().isFloatingPoint()) add += 's';
-              add += suffix(dst.getType());
+      load_integer(*left, result);
 
-              Register dst_register = storage[dst.getId()].getRegister();
-              appendln("  {} {}, {}", add, src, dst_register.toString());
-              return;
-            }
-            case BinOp::Op::Sub:
-            {
-              const Value& left = binop.getLeft();
-              const Value& right = binop.getRight();
-              const Slot& dst = binop.getDst();
+      // only the low bits matter, a 32-bit constant is always an immediate
+      int64_t value = right->getConstant().getIntegerValue();
+      if (wide.getBitwidth() == 32)
+        value = (int32_t) value;
 
-              std::string src;
+      uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+      size_t shift = magnitude == 0 ? 0 : std::countr_zero(magnitude);
+      uint64_t odd = magnitude >> shift;
 
-              // we need to load
-              if (left.isConstant() && isMemory(right))
-              {
-                const Constant constant = left.getConstant();
-                Register dst_storage = allocate_register(constant.getType());
-                load_constant(constant, dst_storage);
+      // x * 0
+      if (magnitude == 0)
+      {
+        emit(Opcode::Mov, { Immediate(0), result });
+      }
+      // x * 2^n = x << n
+      else if (odd == 1)
+      {
+        if (shift > 0)
+          emit(Opcode::Shl, { Immediate(shift), result });
+        if (value < 0)
+          emit(Opcode::Neg, { result });
+      }
+      // x * (3|5|9) * 2^n = lea(x + x * (2|4|8)) << n
+      else if ((odd == 3 || odd == 5 || odd == 9) && value > 0)
+      {
+        emit(Opcode::Lea, { Memory(wide, 0, result.getKnd(), result.getKnd(), odd - 1), result });
+        if (shift > 0)
+          emit(Opcode::Shl, { Immediate(shift), result });
+      }
+      else if (fits_imm32(value))
+      {
+        emit(Opcode::Imul, { Immediate(value), result, result });
+      }
+      else
+      {
+        Register other = allocate_register(wide);
+        emit(Opcode::Movabs, { Immediate(value), other });
+        emit(Opcode::Imul, { other, result });
+      }
 
-                storage[dst.getId()] = dst_storage;
-                src = getMemory(right).toString();
-              }
-              else if (isMemory(left) && right.isConstant())
-              {
-                const Memory& mem = getMemory(left);
-                Register dst_storage = allocate_register(mem.getType());
-                load_memory(mem, dst_storage);
+      place(dst, result);
+    }
+    void generate_div(const BinOp& binop)
+    {
+      const Value& left = binop.getLeft();
+      const Value& right = binop.getRight();
+      const Slot& dst = binop.getDst();
+      const Type& type = dst.getType();
+      const bool modulo = binop.getOp() == BinOp::Op::Mod;
 
-                storage[dst.getId()] = dst_storage;
-                src = constantts(right.getConstant());
-              }
-              else if (isMemory(left) && isMemory(right))
-              {
-                const Memory& mem = getMemory(left);
-                Register dst_storage = allocate_register(mem.getType());
-                load_memory(mem, dst_storage);
+      if (type.isFloatingPoint())
+        return generate_binary(binop, Opcode::Div, false);
 
-                storage[dst.getId()] = dst_storage;
-                src = getMemory(right).toString();
-              }
+      // 8 and 16-bit values are divided as 32-bit values, the result
+      // is the same once truncated
+      Type wide = type;
+      if (wide.getBitwidth() < 32)
+        wide.setBitwidth(32);
 
-              // we need to load in these cases because the sub operation
-              // performs dst -= src, do we need to preserve the sides
-              else if (isMemory(left) && isRegister(right))
-              {
-                const Memory& mem = getMemory(left);
-                Register dst_storage = allocate_register(mem.getType());
-                load_memory(mem, dst_storage);
+      const size_t bitwidth = wide.getBitwidth();
+      const bool signd = type.isSigned();
 
-                storage[dst.getId()] = dst_storage;
+      const Register rax(wide, Register::Knd::RAX);
+      const Register rdx(wide, Register::Knd::RDX);
+      // `op $value, reg` or through a register if the value doesn't fit
+      auto immediate = [&](Opcode op, int64_t value, const Register& reg)
+      {
+        if (bitwidth == 32 || fits_imm32(value))
+        {
+          emit(op, { Immediate(value), reg });
+          return;
+        }
 
-                Register rr = getRegister(right);
-                src = rr.toString();
-                
-                // special case: we don't need the right register anymore
-                deallocate(rr);
-              }
-              else if (left.isConstant() && isRegister(right))
-              {
-                const Constant& constant = left.getConstant();
-                Register dst_storage = allocate_register(constant.getType());
-                load_constant(constant, dst_storage);
+        Register tmp = allocate_register(wide, {Register::Knd::RAX, Register::Knd::RDX});
+        emit(Opcode::Movabs, { Immediate(value), tmp });
+        emit(op, { tmp, reg });
+      };
 
-                storage[dst.getId()] = dst_storage;
-                Register rr = getRegister(right);
-                src = rr.toString();
+      int64_t divisor = right.isConstant() ? right.getConstant().getIntegerValue() : 0;
+      uint64_t magnitude = 0;
+      if (right.isConstant())
+      {
+        magnitude = signd && divisor < 0 ? -(uint64_t) divisor : (uint64_t) divisor;
+        if (bitwidth == 32)
+          magnitude &= 0xFFFFFFFF;
+      }
+      const bool power_of_two = magnitude != 0 && (magnitude & (magnitude - 1)) == 0;
 
-                // special case: we don't need the right register anymore
-                deallocate(rr);
-              }
+      // x / 2^n
+      if (right.isConstant() && power_of_two)
+      {
+        const size_t shift = std::countr_zero(magnitude);
+        Register x = target(dst);
+        x.setType(wide);
+        load_integer(left, x);
 
-              // we may re-use an operation side register
-              // because the left side is a register
-              if (isRegister(left) && isRegister(right))
-              {
-                storage[dst.getId()] = getRegister(left);
+        if (!signd)
+        {
+          // x % 2^n = x & (2^n - 1)
+          if (modulo && (bitwidth == 32 || fits_imm32(magnitude - 1)))
+          {
+            emit(Opcode::And, { Immediate(magnitude - 1), x });
+          }
+          // the mask doesn't fit, clear the upper bits with shifts
+          else if (modulo)
+          {
+            emit(Opcode::Shl, { Immediate(bitwidth - shift), x });
+            emit(Opcode::Shr, { Immediate(bitwidth - shift), x });
+          }
+          else if (shift > 0)
+          {
+            emit(Opcode::Shr, { Immediate(shift), x });
+          }
+        }
+        else if (modulo && shift == 0)
+        {
+          // x % 1 = x % -1 = 0
+          emit(Opcode::Mov, { Immediate(0), x });
+        }
+        else
+        {
+          // round toward zero: add (2^n - 1) to negative values first
+          if (shift > 0)
+          {
+            Register bias = allocate_register(wide);
 
-                Register rr = getRegister(right);
-                src = rr.toString();
+            emit(Opcode::Mov, { x, bias });
+            emit(Opcode::Sar, { Immediate(bitwidth - 1), bias });
+            emit(Opcode::Shr, { Immediate(bitwidth - shift), bias });
 
-                // special case: deallocate the right register
-                deallocate(rr);
-              }
-              else if (isRegister(left) && isMemory(right))
+            if (modulo)
+            {
+              // x - ((x + bias) & -2^n)
+              emit(Opcode::Add, { x, bias });
+              if (bitwidth == 32 || fits_imm32(-(int64_t) magnitude))
               {
-                // the left register is the destination
-                storage[dst.getId()] = getRegister(left);
-                // the right (memory) is the src
-                src = getMemory(right).toString();
+                emit(Opcode::And, { Immediate(-(int64_t) magnitude), bias });
               }
-              else if (isRegister(left) && right.isConstant())
+              else
               {
-                // the left register is the destination
-                storage[dst.getId()] = getRegister(left);
-                // the right (constant) is the src
-                src = constantts(right.getConstant());
+                emit(Opcode::Sar, { Immediate(shift), bias });
+                emit(Opcode::Shl, { Immediate(shift), bias });
               }
-
-              // same form as add
-              std::string sub = "sub";
-              if (dst.getType().isFloatingPoint()) sub += 's';
-              sub += suffix(dst.getType());
-
-              Register dst_register = storage[dst.getId()].getRegister();
-              appendln("  {} {}, {}", sub, src, dst_register.toString());
-              return;
+              emit(Opcode::Sub, { bias, x });
+            }
+            else
+            {
+              emit(Opcode::Add, { bias, x });
+              emit(Opcode::Sar, { Immediate(shift), x });
             }
-            default:
-              todo();
+          }
+
+          if (!modulo && divisor < 0)
+            emit(Opcode::Neg, { x });
+        }
+
+        return place(dst, x);
+      }
+
+      // x / d = mulhi(x, magic) >> s
+      if (right.isConstant() && magnitude > 1)
+      {
+        // the dividend is only read, it can stay where it is unless
+        // it's in rax, rdx or needs to be extended
+        Operand xs;
+        if (bitwidth == type.getBitwidth() && isMemory(left))
+        {
+          xs = getMemory(left);
+        }
+        else if (bitwidth == type.getBitwidth() && isRegister(left)
+            && !aliases(left, rax) && !aliases(left, rdx))
+        {
+          xs = getRegister(left);
+        }
+        else
+        {
+          Register x = allocate_register(wide, {Register::Knd::RAX, Register::Knd::RDX});
+          load_integer(left, x);
+          xs = x;
+        }
+
+        // the quotient ends up in rdx
+        if (signd)
+        {
+          SignedMagic magic = signed_magic(divisor, bitwidth);
+          if (bitwidth == 64 && !fits_imm32(magic.multiplier))
+            emit(Opcode::Movabs, { Immediate(magic.multiplier), rax });
+          else
+            emit(Opcode::Mov, { Immediate(magic.multiplier), rax });
+
+          emit(Opcode::Imul, { xs });
+          if (divisor > 0 && magic.multiplier < 0)
+            emit(Opcode::Add, { xs, rdx });
+          else if (divisor < 0 && magic.multiplier > 0)
+            emit(Opcode::Sub, { xs, rdx });
+          if (magic.shift > 0)
+            emit(Opcode::Sar, { Immediate(magic.shift), rdx });
+
+          // add 1 to negative quotients
+          emit(Opcode::Mov, { rdx, rax });
+          emit(Opcode::Shr, { Immediate(bitwidth - 1), rax });
+          emit(Opcode::Add, { rax, rdx });
+        }
+        else
+        {
+          UnsignedMagic magic = unsigned_magic(magnitude, bitwidth);
+          if (bitwidth == 64 && magic.multiplier > INT32_MAX)
+            emit(Opcode::Movabs, { Immediate(magic.multiplier), rax });
+          else
+            emit(Opcode::Mov, { Immediate(magic.multiplier), rax });
+
+          emit(Opcode::Mul, { xs });
+          if (!magic.add)
+          {
+            if (magic.shift > 0)
+              emit(Opcode::Shr, { Immediate(magic.shift), rdx });
+          }
+          else
+          {
+            // q = (((x - hi) >> 1) + hi) >> (s - 1)
+            emit(Opcode::Mov, { xs, rax });
+            emit(Opcode::Sub, { rdx, rax });
+            emit(Opcode::Shr, { Immediate(1), rax });
+            emit(Opcode::Add, { rax, rdx });
+            if (magic.shift > 1)
+              emit(Opcode::Shr, { Immediate(magic.shift - 1), rdx });
+          }
+        }
+
+        if (!modulo)
+          return place(dst, rdx);
+
+        // x - q * d
+        immediate(Opcode::Imul, divisor, rdx);
+        emit(Opcode::Mov, { xs, rax });
+        emit(Opcode::Sub, { rdx, rax });
+        return place(dst, rax);
+      }
+
+      // the generic (i)div, the divisor can't live in rax or rdx
+      // and 8/16-bit values need to be extended first
+      Operand ds;
+      if (isRegister(right) && bitwidth == type.getBitwidth()
+          && !aliases(right, rax) && !aliases(right, rdx))
+      {
+        ds = getRegister(right);
+      }
+      else if (isMemory(right) && bitwidth == type.getBitwidth())
+      {
+        ds = getMemory(right);
+      }
+      else
+      {
+        Register d = allocate_register(wide, {Register::Knd::RAX, Register::Knd::RDX});
+        load_integer(right, d);
+        ds = d;
+      }
+
+      load_integer(left, rax);
+
+      if (signd)
+        emit(bitwidth == 64 ? Opcode::Cqto : Opcode::Cltd);
+      else
+        emit(Opcode::Xor, { Register(Type(Type::Knd::Integer, 32), Register::Knd::RDX), Register(Type(Type::Knd::Integer, 32), Register::Knd::RDX) });
+
+      emit(signd ? Opcode::Idiv : Opcode::Div, { ds });
+      place(dst, modulo ? rdx : rax);
+    }
+    // returns true if the multiplication at `position` can be fused with
+    // the addition after it: `x = a * b; y = x + c` where only y reads x
+    bool fuses(const std::vector<Instruction>& body, size_t position)
+    {
+      if (!options.fp_contract || !avx() || position + 1 >= body.size())
+        return false;
+      if (body[position].index() != 3 || body[position + 1].index() != 3)
+        return false;
+
+      const auto& mul = std::get<3>(body[position]);
+      const auto& add = std::get<3>(body[position + 1]);
+      if (mul.getOp() != BinOp::Op::Mul || !mul.getDst().getType().isFloatingPoint())
+        return false;
+      if (add.getOp() != BinOp::Op::Add && add.getOp() != BinOp::Op::Sub)
+        return false;
+
+      const size_t id = mul.getDst().getId();
+      auto it = std::find_if(intervals.begin(), intervals.end(), [&](const Interval& interval) {
+        return interval.slot.getId() == id;
+      });
+      if (it == intervals.end() || it->uses != std::vector<size_t>{ position + 1 })
+        return false;
+
+      auto reads = [&](const Value& v) { return v.isSlot() && v.getSlot().getId() == id; };
+      return reads(add.getLeft()) != reads(add.getRight());
+    }
+    // generates `a * b + c`, `a * b - c` or `c - a * b` as one FMA
+    void generate_fma(const BinOp& mul, const BinOp& add)
+    {
+      const size_t id = mul.getDst().getId();
+      const bool product_left = add.getLeft().isSlot() && add.getLeft().getSlot().getId() == id;
+      const Value& addend = product_left ? add.getRight() : add.getLeft();
+
+      Opcode op = Opcode::Fmadd;
+      if (add.getOp() == BinOp::Op::Sub)
+        op = product_left ? Opcode::Fmsub : Opcode::Fnmadd;
+
+      // the factors are read where the product would be, keep their
+      // registers away from the temporaries
+      const Value* a = &mul.getLeft();
+      const Value* b = &mul.getRight();
+      for (const Value* factor : { a, b })
+        if (isRegister(*factor))
+          pool[static_cast<int>(getRegister(*factor).getKnd())].second = true;
+
+      // the accumulator is overwritten, it can't be a factor's register
+      Register result = target(add.getDst());
+      Register accumulator = result;
+      if (!aliases(addend, result) && (aliases(*a, result) || aliases(*b, result)))
+        accumulator = allocate_register(result.getType());
+      load(addend, accumulator);
+
+      // the second factor can be in memory
+      if (!isRegister(*a))
+        std::swap(a, b);
+
+      Operand first;
+      if (isRegister(*a))
+      {
+        first = getRegister(*a);
+      }
+      else
+      {
+        Register reg = allocate_register(result.getType());
+        load(*a, reg);
+        first = reg;
+      }
+
+      emit(op, { operand(*b), first, accumulator });
+      place(add.getDst(), accumulator);
+    }
+    // moves the sources to the destinations all at once, the
+    // scratch registers break the cycles
+    void parallel_move(std::vector<std::pair<Register, Register>> moves)
+    {
+      std::erase_if(moves, [](const auto& move) { return move.first.getKnd() == move.second.getKnd(); });
+
+      while (!moves.empty())
+      {
+        // a destination that no other move reads
+        auto it = std::find_if(moves.begin(), moves.end(), [&](const auto& move) {
+          return std::none_of(moves.begin(), moves.end(), [&](const auto& other) {
+            return &other != &move && other.first.getKnd() == move.second.getKnd();
+          });
+        });
+
+        if (it == moves.end())
+        {
+          Register& src = moves.front().first;
+          Register scratch(src.getType(), uses_xmm(src.getType()) ? Register::Knd::XMM15 : Register::Knd::R11);
+          emit(Opcode::Mov, { src, scratch });
+          src = scratch;
+          continue;
+        }
+
+        emit(Opcode::Mov, { it->first, it->second });
+        moves.erase(it);
+      }
+    }
+    // puts the arguments where the callee expects them (SysV)
+    // Returns: the bytes pushed for the stack arguments
+    size_t pass_arguments(const std::vector<Value>& args)
+    {
+      std::vector<Type> types;
+      for (const auto& arg : args)
+        types.push_back(arg.getType());
+
+      auto registers = argument_registers(types);
+
+      // the arguments that don't fit in the registers are passed 8 bytes
+      // each on the stack, %rsp stays aligned to 16 bytes
+      size_t stack_args = std::count(registers.begin(), registers.end(), std::nullopt);
+      size_t stack_bytes = (stack_args * 8 + 15) / 16 * 16;
+      const Register rsp(Type(Type::Knd::Integer, 64), Register::Knd::RSP);
+      if (stack_bytes > 0)
+        emit(Opcode::Sub, { Immediate(stack_bytes), rsp });
+
+      off_t stack_args_offset = 0;
+      for (size_t i = 0; i < args.size(); ++i)
+      {
+        if (registers[i].has_value())
+          continue;
+
+        const Type& type = args[i].getType();
+        Register scratch(type, uses_xmm(type) ? Register::Knd::XMM15 : Register::Knd::R11);
+        load(args[i], scratch);
+        emit(Opcode::Mov, { scratch, Memory(type, stack_args_offset, Register::Knd::RSP) });
+        stack_args_offset += 8;
+      }
+
+      // the registers first since loading the others
+      // may overwrite one of them
+      std::vector<std::pair<Register, Register>> moves;
+      for (size_t i = 0; i < args.size(); ++i)
+        if (registers[i].has_value() && isRegister(args[i]))
+          moves.push_back({ getRegister(args[i]), Register(args[i].getType(), *registers[i]) });
+      parallel_move(std::move(moves));
+
+      for (size_t i = 0; i < args.size(); ++i)
+        if (registers[i].has_value() && !isRegister(args[i]))
+          load(args[i], Register(args[i].getType(), *registers[i]));
+
+      return stack_bytes;
+    }
+    // adds `vzeroupper` before leaving the code that used the ymm
+    // registers, the SSE code after it is slow otherwise. Unless they
+    // pass a 32-byte vector to the code after
+    void clear_upper(const std::vector<Type>& passed)
+    {
+      auto wide = [](const Type& type) { return type.isVector() && type.getByteSize() == 32; };
+      if (ymm && std::none_of(passed.begin(), passed.end(), wide))
+        emit(Opcode::Vzeroupper);
+    }
+    std::vector<Type> argument_types(const Call& call)
+    {
+      std::vector<Type> types;
+      for (const auto& arg : call.getArgs())
+        types.push_back(arg.getType());
+      return types;
+    }
+    void generate_call(const Call& call)
+    {
+      size_t stack_bytes = pass_arguments(call.getArgs());
+      clear_upper(argument_types(call));
+
+      // the functions defined somewhere else go through the PLT
+      if (defined.contains(call.getName()))
+        emit(Opcode::Call, { Symbol(call.getName()) });
+      else
+        emit(Opcode::Call, { Symbol(call.getName() + "@PLT") });
+
+      if (stack_bytes > 0)
+        emit(Opcode::Add, { Immediate(stack_bytes), Register(Type(Type::Knd::Integer, 64), Register::Knd::RSP) });
+
+      const Slot& dst = call.getDst();
+      if (!dst.getType().isVoid())
+        place(dst, Register(dst.getType(), uses_xmm(dst.getType()) ? Register::Knd::XMM0 : Register::Knd::RAX));
+    }
+    // returns the operand a store to memory reads `value` from, memory to
+    // memory moves and the constants that can't be an immediate go through
+    // a register
+    Operand store_source(const Value& value, const Type& type)
+    {
+      if (isRegister(value))
+        return Register(type, getRegister(value).getKnd());
+      if (value.isConstant() && type.isInteger() && fits_imm32(value.getConstant().getIntegerValue()))
+        return operand(value.getConstant());
+
+      Register tmp = allocate_register(type);
+      load(value, tmp);
+      return tmp;
+    }
+    // returns the memory of `array[index * stride + offset]`, %rip can't
+    // have an index so the address of a global array is loaded first
+    Memory element(const Slot& array, const Value& index, size_t stride, int64_t offset)
+    {
+      const Type& type = array.getType().getElement();
+      const Type wide(Type::Knd::Integer, 64);
+      size_t scale = type.getByteSize();
+
+      Memory mem = storage[array.getId()].getMemory();
+      mem.setType(type);
+      mem.setOffset(mem.getOffset() + offset * (off_t) scale);
+      if (index.isConstant())
+      {
+        mem.setOffset(mem.getOffset() + index.getConstant().getIntegerValue() * (off_t) (scale * stride));
+        return mem;
+      }
+      scale *= stride;
+
+      Register position = isRegister(index) ? Register(wide, getRegister(index).getKnd()) : allocate_register(wide);
+      if (!isRegister(index))
+        load_memory(getMemory(index), position);
+
+      // the vectors are bigger than the biggest scale
+      bool loaded = !isRegister(index);
+      if (scale > 8)
+      {
+        if (!loaded)
+        {
+          position = allocate_register(wide);
+          load_register(Register(wide, getRegister(index).getKnd()), position);
+          loaded = true;
+        }
+
+        emit(Opcode::Shl, { Immediate(std::countr_zero(scale)), position });
+        scale = 1;
+      }
+
+      if (!mem.getSymbol().has_value())
+        return Memory(type, mem.getOffset(), mem.getBase(), position.getKnd(), scale);
+
+      Register base = allocate_register(wide);
+      emit(Opcode::Lea, { mem, base });
+      if (!loaded)
+        return Memory(type, 0, base.getKnd(), position.getKnd(), scale);
+
+      // the loaded index is free again once it's in the address
+      emit(Opcode::Lea, { Memory(type, 0, base.getKnd(), position.getKnd(), scale), base });
+      deallocate(position);
+      return Memory(type, 0, base.getKnd());
+    }
+    void generate_load_element(const LoadElement& load)
+    {
+      const Slot& dst = load.getDst();
+      Memory src = element(load.getArray().getSlot(), load.getIndex(), load.getStride(), load.getOffset());
+      // a vector loads all its lanes from there
+      src.setType(dst.getType());
+
+      Register result = target(dst);
+      emit(Opcode::Mov, { src, result });
+      place(dst, result);
+    }
+    void generate_store_element(const StoreElement& store)
+    {
+      Memory dst = element(store.getDst(), store.getIndex(), store.getStride(), store.getOffset());
+      if (store.getSrc().getType().isVector())
+        dst.setType(store.getSrc().getType());
+
+      emit(Opcode::Mov, { store_source(store.getSrc(), dst.getType()), dst });
+    }
+    // returns the label of the elements in .rodata, equal
+    // literals share their data
+    std::string array_label(const std::vector<Constant>& elements)
+    {
+      std::vector<Data> data;
+      for (const auto& element : elements)
+        data.push_back(Data(element));
+
+      DataLabel label(std::format(".LA{}", arrays.size()), data);
+      std::string key = label.toString().substr(label.getName().size());
+      if (auto it = array_labels.find(key); it != array_labels.end())
+        return arrays[it->second].getName();
+
+      array_labels[key] = arrays.size();
+      arrays.push_back(label);
+      return label.getName();
+    }
+    // copies the elements from .rodata, the big arrays with `rep movsb`
+    // and the others through a vector register then a general one for
+    // the tail. Up to `2 * unroll` vectors are copied one after the other,
+    // more by a loop moving `unroll` of them per iteration, the rest
+    // after it. The loop needs the array in the frame, the index
+    // register can't be added to a %rip address
+    void generate_init_array(const InitArray& init)
+    {
+      const Slot& array = init.getDst();
+      const size_t size = array.getType().getByteSize();
+
+      const Memory src(array.getType(), array_label(init.getElements()));
+      const Memory dst = storage[array.getId()].getMemory();
+
+      if (uses_rep_movsb(init))
+      {
+        const Type wide(Type::Knd::Integer, 64);
+        emit(Opcode::Lea, { dst, Register(wide, Register::Knd::RDI) });
+        emit(Opcode::Lea, { src, Register(wide, Register::Knd::RSI) });
+        emit(Opcode::Mov, { Immediate(size), Register(Type(Type::Knd::Integer, 32), Register::Knd::RCX) });
+        emit(Opcode::RepMovsb);
+        return;
+      }
+
+      // the part of `mem` at `offset`
+      auto at = [](Memory mem, size_t offset, const Type& type)
+      {
+        mem.setOffset(mem.getOffset() + (off_t) offset);
+        mem.setType(type);
+        return mem;
+      };
+
+      size_t offset = 0;
+      const Type vector(Type::Knd::Vector, Type(Type::Knd::Float, 32), avx() ? 8 : 4);
+      const size_t width = vector.getByteSize();
+      const size_t block = options.unroll * width;
+      const Type wide(Type::Knd::Integer, 64);
+      Register reg = allocate_register(vector);
+      Register tmp = allocate_register(wide);
+
+      if (size / width >= 2 * options.unroll && !dst.getSymbol().has_value())
+      {
+        // the index runs from -looped up to 0 where the `add` ends the loop,
+        // `tmp` points to the end of the looped part of the elements
+        const size_t looped = size / block * block;
+        Register index = allocate_register(wide);
+        Symbol label(std::format(".L{}.copy{}", machine.getName(), copy_loops++));
+
+        emit(Opcode::Lea, { at(src, looped, wide), tmp });
+        emit(Opcode::Mov, { Immediate(-(int64_t) looped), index });
+        emit(Opcode::Label, { label });
+        for (size_t k = 0; k < options.unroll; ++k)
+        {
+          const off_t part = (off_t) (k * width);
+          emit(Opcode::Movups, { Memory(vector, part, tmp.getKnd(), index.getKnd(), 1), reg });
+          emit(Opcode::Movups, { reg, Memory(vector, dst.getOffset() + (off_t) looped + part, dst.getBase(), index.getKnd(), 1) });
+        }
+        emit(Opcode::Add, { Immediate(block), index });
+        emit(Opcode::Jne, { label });
+        offset = looped;
+      }
+      else if (size >= 2 * width)
+        unrolled_copies++;
+
+      for (; offset + width <= size; offset += width)
+      {
+        emit(Opcode::Movups, { at(src, offset, vector), reg });
+        emit(Opcode::Movups, { reg, at(dst, offset, vector) });
+      }
+      // the last 16 bytes of a ymm copy go through its lower half
+      if (width == 32 && offset + 16 <= size)
+      {
+        const Type half(Type::Knd::Vector, vector.getElement(), 4);
+        reg.setType(half);
+        emit(Opcode::Movups, { at(src, offset, half), reg });
+        emit(Opcode::Movups, { reg, at(dst, offset, half) });
+        offset += 16;
+      }
+
+      for (size_t chunk : { 8, 4, 2, 1 })
+      {
+        const Type type(Type::Knd::Integer, chunk * 8);
+        tmp.setType(type);
+        for (; offset + chunk <= size; offset += chunk)
+        {
+          emit(Opcode::Mov, { at(src, offset, type), tmp });
+          emit(Opcode::Mov, { tmp, at(dst, offset, type) });
+        }
+      }
+    }
+    // reads the lanes of a vector in another order: `pshufd` moves the
+    // 4-byte parts of each 16-byte half, `vpermps` the ones of the whole
+    // ymm register and `vextractf128` brings the upper half down. The lane
+    // a scalar reads ends up in the low part
+    void generate_shuffle(const Shuffle& shuffle)
+    {
+      const Value& src = shuffle.getSrc();
+      const Slot& dst = shuffle.getDst();
+      const Type& type = src.getType();
+      const Type& lane = type.getElement();
+      const size_t parts = lane.getByteSize() / 4;
+
+      // the legacy SSE forms fault on unaligned memory
+      Register vector;
+      if (isRegister(src))
+        vector = getRegister(src);
+      else
+      {
+        vector = allocate_register(type);
+        load(src, vector);
+      }
+
+      // the `pshufd` immediate, 2 bits per 4-byte part
+      auto immediate = [&](const std::vector<size_t>& lanes)
+      {
+        int64_t imm = 0;
+        for (size_t l = 0; l < lanes.size(); ++l)
+          for (size_t k = 0; k < parts; ++k)
+            imm |= (int64_t) (lanes[l] * parts + k) << (2 * (l * parts + k));
+        return imm;
+      };
+
+      Register result = target(dst);
+      if (dst.getType().isVector())
+      {
+        if (type.getByteSize() == 16)
+        {
+          emit(Opcode::Pshufd, { Immediate(immediate(shuffle.getLanes())), vector, result });
+        }
+        else
+        {
+          assert(parts == 1);
+          const Type index(Type::Knd::Integer, 32);
+          const Type indices(Type::Knd::Vector, index, type.getLength());
+
+          std::vector<Constant> order;
+          for (size_t l : shuffle.getLanes())
+            order.push_back(Constant(index, (int64_t) l));
+
+          Register reg = allocate_register(indices);
+          load_memory(Memory(indices, array_label(order)), reg);
+          emit(Opcode::Vpermps, { vector, reg, result });
+        }
+
+        return place(dst, result);
+      }
+
+      size_t position = shuffle.getLanes().front();
+      const size_t half = 16 / lane.getByteSize();
+
+      Register part = vector;
+      bool temporary = false;
+      if (position >= half)
+      {
+        part = allocate_register(Type(Type::Knd::Vector, lane, half));
+        emit(Opcode::Vextractf128, { Immediate(1), vector, part });
+        // still shuffled with VEX
+        part.setType(type);
+        position -= half;
+        temporary = true;
+      }
+
+      if (position != 0)
+      {
+        // a floating point is shuffled in place
+        Register shuffled = uses_xmm(dst.getType()) ? result : temporary ? part : allocate_register(type);
+        shuffled.setType(type);
+        emit(Opcode::Pshufd, { Immediate(immediate({ position })), part, shuffled });
+        part = shuffled;
+      }
+
+      if (dst.getType().isFloatingPoint())
+      {
+        if (part.getKnd() != result.getKnd())
+          load_register(Register(dst.getType(), part.getKnd()), result);
+      }
+      else
+        emit(Opcode::Movd, { Register(dst.getType(), part.getKnd()), result });
+
+      place(dst, result);
+    }
+    void generate_instruction(Instruction& instruction)
+    {
+      switch (instruction.index())
+      {
+        case 0: // Alloca
+        {
+          // the variable got its stack slot from `layout_frame()`
+          return;
+        }
+        case 1: // Store
+        {
+          const auto& store = std::get<1>(instruction);
+          const Storage& dst = storage[store.getDst().getId()];
+
+          emit(Opcode::Mov, { store_source(store.getSrc(), store.getDst().getType()), dst });
+          return;
+        }
+        case 2: // Convert
+        {
+          auto& convert = std::get<2>(instruction);
+
+          if (!convert.getSrc().isSlot())
+          {
+            std::println("Error: the source should be a valid Slot when Casting");
+            exit(1);
+          }
+
+          Slot& src = convert.getSrc().getSlot();
+          Slot& dst = convert.getDst();
+
+          const Type& sty = src.getType();
+          const Type& dty = dst.getType();
+
+          // int to int
+          if (sty.isInteger() && dty.isInteger())
+            return int2int(src, dst);
+
+          // int to float
+          else if (sty.isInteger() && dty.isFloatingPoint())
+            return int2float(src, dst);
+
+          // float to int
+          else if (sty.isFloatingPoint() && dty.isInteger())
+            return float2int(src, dst);
+
+          // float to float
+          else if (sty.isFloatingPoint() && dty.isFloatingPoint())
+            return float2float(src, dst);
+
+          // idk
+          else
+            unreachable();
+        }
+        case 3: // BinOp
+        {
+          const auto& binop = std::get<3>(instruction);
+          if (binop.getDst().getType().isVector())
+            return generate_packed(binop);
+
+          // NOTE: Constant, Constant case is handled in the IR
+          // `constant_folding`
+          switch (binop.getOp())
+          {
+            case BinOp::Op::Add: return generate_binary(binop, Opcode::Add, true);
+            case BinOp::Op::Sub: return generate_binary(binop, Opcode::Sub, false);
+            case BinOp::Op::Mul: return generate_mul(binop);
+            case BinOp::Op::Div:
+            case BinOp::Op::Mod: return generate_div(binop);
+            default:             unreachable();
           }
         }
         case 4: // UnOp
         {
           todo();
         }
+        case 5: // Call
+        {
+          return generate_call(std::get<5>(instruction));
+        }
+        case 6: // LoadElement
+        {
+          return generate_load_element(std::get<6>(instruction));
+        }
+        case 7: // StoreElement
+        {
+          return generate_store_element(std::get<7>(instruction));
+        }
+        case 8: // InitArray
+        {
+          return generate_init_array(std::get<8>(instruction));
+        }
+        case 9: // Shuffle
+        {
+          return generate_shuffle(std::get<9>(instruction));
+        }
       }
       unreachable();
     }
-    void generate_data(const std::vector<DataLabel>& data)
+    // restores the callee-saved registers and %rsp as they were
+    // when the function was called
+    void generate_epilogue()
+    {
+      for (const auto& [reg, mem] : saved)
+        emit(Opcode::Mov, { mem, reg });
+
+      if (frame_pointer && stack_size > 0)
+        emit(Opcode::Leave);
+      else if (frame_pointer)
+        emit(Opcode::Pop, { Register(Type(Type::Knd::Integer, 64), Register::Knd::RBP) });
+      else if (stack_size > 0)
+        emit(Opcode::Add, { Immediate(stack_size), Register(Type(Type::Knd::Integer, 64), Register::Knd::RSP) });
+    }
+    // the callee returns straight to our caller, a call to the
+    // function itself jumps back to its body
+    void generate_tail_call(const Function& fn, const Call& call)
     {
-      for (const auto& elm : data)
+      pass_arguments(call.getArgs());
+
+      if (call.getName() == fn.getName())
       {
-        appendln();
-        append("{}", elm.toString());
+        emit(Opcode::Jmp, { Symbol(std::format(".L{}.entry", fn.getName())) });
+        return;
       }
+
+      generate_epilogue();
+      clear_upper(argument_types(call));
+      if (defined.contains(call.getName()))
+        emit(Opcode::Jmp, { Symbol(call.getName()) });
+      else
+        emit(Opcode::Jmp, { Symbol(call.getName() + "@PLT") });
     }
     void generate_terminator(const Return& terminator)
     {
@@ -694,111 +1490,301 @@ namespace soft {
       return_register.setKnd(return_knd);
 
       const Value& value = terminator.getValue();
+      if (value.isConstant() || value.isSlot())
+        load(value, return_register);
 
-      // constants
-      if (value.isConstant())
-      {
-        load_constant(value.getConstant(), return_register);
-      }
+      generate_epilogue();
+      clear_upper({ terminator.getType() });
+      emit(Opcode::Ret);
+    }
+    void generate_params(const std::vector<Slot>& params)
+    {
+      std::vector<Type> types;
+      for (const auto& param : params)
+        types.push_back(param.getType());
 
-      // slots
-      else if (value.isSlot())
+      auto incoming = argument_registers(types);
+      // above the return address and the saved %rbp
+      off_t stack_params_offset = frame_pointer ? 16 : stack_size + 8;
+      const Register::Knd base = frame_pointer ? Register::Knd::RBP : Register::Knd::RSP;
+
+      // the parameters that got a different register than the one they arrived in
+      std::vector<std::pair<Register, Register>> moves;
+      for (size_t i = 0; i < params.size(); ++i)
       {
-        const Storage& stored = storage[value.getSlot().getId()];
+        const Slot& param = params[i];
+
+        // the parameters on the stack stay there, every one takes 8 bytes
+        if (!incoming[i].has_value())
+        {
+          storage[param.getId()] = Memory(param.getType(), stack_params_offset, base);
+          stack_params_offset += 8;
+          continue;
+        }
+
+        // sized to the parameter type
+        Register src(param.getType(), *incoming[i]);
+        const Storage& dst = storage[param.getId()];
 
-        if (stored.isMemory())
-          load_memory(stored.getMemory(), return_register);
-        else if (stored.isRegister() && stored.getRegister().getKnd() != return_knd)
-          load_register(stored.getRegister(), return_register);
+        if (dst.isRegister())
+          moves.push_back({ src, dst.getRegister() });
+        else
+          emit(Opcode::Mov, { src, dst });
       }
 
-      appendln("  popq %rbp");
-      appendln("  retq");
+      parallel_move(std::move(moves));
     }
-    void generate_params(const std::vector<Slot>& params)
+    void generate_function(Function& fn)
     {
-      static constexpr std::array<std::string_view, 6> integer_regs = {
-        "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"
-      };
-      static constexpr std::array<std::string_view, 8> float_regs = {
-        "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7"
+      if (!fn.isDefined())
+        return; // do nothing
+
+      // the ymm registers are AVX
+      auto uses_ymm = [](const Type& type)
+      {
+        const Type& value = type.isArray() ? type.getElement() : type;
+        return value.isVector() && value.getByteSize() == 32;
       };
+      bool wide = std::any_of(fn.getParams().begin(), fn.getParams().end(), [&](const Slot& param) { return uses_ymm(param.getType()); });
+      for (const auto& instruction : fn.getBody())
+        wide = wide || uses_ymm(getDestination(instruction).getType());
+      if (wide && !avx())
+      {
+        std::println("The 32-byte vectors in '{}' need -march=x86-64-v3 or later", fn.getName());
+        exit(1);
+      }
+      // the array copies too
+      ymm = wide || (avx() && std::any_of(fn.getBody().begin(), fn.getBody().end(), [](const Instruction& instruction) {
+        return instruction.index() == 8 && !uses_rep_movsb(std::get<8>(instruction)) && getDestination(instruction).getType().getByteSize() >= 32;
+      }));
+
+      size_t total_registers = fn.getTotalRegisters();
+      size_t capacity = storage.max_load_factor() * storage.bucket_count();
+      if (total_registers > capacity)
+        storage.reserve(total_registers - capacity);
 
-      size_t integer_index = 0;
-      size_t float_index = 0;
-      off_t stack_params_offset = 16;
+      machine = MachineFunction(fn.getName());
 
-      for (const auto& param : params)
+      // nothing is reserved across functions
+      storage.clear();
+      intervals.clear();
+      saved.clear();
+
+      // leaf functions address their frame through %rsp
+      frame_pointer = !is_leaf(fn);
+
+      // the temporaries get their register or stack slot before
+      // any instruction is generated
+      intervals = live_intervals(fn);
+      auto allocation = options.opt_level >= 2 ? graph_coloring(fn, intervals, frame_pointer) : linear_scan(fn, intervals, frame_pointer);
+      for (auto& [id, stored] : allocation)
       {
-        const std::string mov = movts(param.getType());
+        storage[id] = stored;
+
+        // the callee-saved registers are saved by the prologue
+        if (!stored.isRegister() || !stored.getRegister().isCalleeSaved())
+          continue;
+
+        Register reg(Type(Type::Knd::Integer, 64), stored.getRegister().getKnd());
+        if (std::none_of(saved.begin(), saved.end(), [&](const auto& save) { return save.first.getKnd() == reg.getKnd(); }))
+          saved.push_back({ reg, Memory() });
+      }
+
+      // then the stack slots of the parameters, the variables
+      // and the spills
+      auto objects = stack_objects(fn, intervals, allocation);
+      for (size_t i = 0; i < saved.size(); ++i)
+        objects.push_back({ std::nullopt, saved[i].first.getType(), 0, fn.getBody().size() });
 
-        // the destination
-        offset += param.getType().getByteSize();
-        Memory mem(param.getType(), offset);
+      // a leaf function doesn't move %rsp if its frame
+      // fits in the red zone
+      const size_t frame_size = layout_frame(objects);
+      stack_size = !frame_pointer && frame_size <= red_zone_size ? 0 : frame_size;
+
+      for (size_t i = 0, save = 0; i < objects.size(); ++i)
+      {
+        const StackObject& object = objects[i];
+        Memory mem = frame_pointer
+          ? Memory(object.type, -(off_t) object.offset)
+          : Memory(object.type, (off_t) stack_size - (off_t) object.offset, Register::Knd::RSP);
+
+        if (object.slot.has_value())
+          storage[*object.slot] = mem;
+        else
+          saved[save++].second = mem;
+      }
 
-        const bool is_integer = param.getType().isInteger();
-        size_t& index = is_integer ? integer_index : float_index;
-        const size_t end = is_integer ? integer_regs.size() : float_regs.size();
+      // the globals are addressed relative to %rip
+      for (const auto& instruction : fn.getBody())
+        if (instruction.index() == 0 && std::get<0>(instruction).isGlobal()) // Alloca
+          storage[std::get<0>(instruction).getDst().getId()] = Memory(std::get<0>(instruction).getType(), std::get<0>(instruction).getGlobal());
 
-        if (index < end)
+      // prologue
+      const Register rbp(Type(Type::Knd::Integer, 64), Register::Knd::RBP);
+      const Register rsp(Type(Type::Knd::Integer, 64), Register::Knd::RSP);
+      if (frame_pointer)
+      {
+        emit(Opcode::Push, { rbp });
+        emit(Opcode::Mov, { rsp, rbp });
+      }
+      if (stack_size > 0)
+        emit(Opcode::Sub, { Immediate(stack_size), rsp });
+
+      // the parameters may be moved to the saved registers
+      for (const auto& [reg, mem] : saved)
+        emit(Opcode::Mov, { reg, mem });
+
+      // where the self tail calls jump with the new arguments
+      const bool tail = is_tail_call(fn);
+      auto& body = fn.getBody();
+      if (tail && std::get<5>(body.back()).getName() == fn.getName())
+        emit(Opcode::Label, { Symbol(std::format(".L{}.entry", fn.getName())) });
+
+      reserve(0);
+      generate_params(fn.getParams());
+
+      for (size_t i = 0; i < body.size(); ++i)
+      {
+        reserve(i);
+        if (tail && i + 1 == body.size())
         {
-          const std::string_view& src = is_integer ? integer_regs[index++] : float_regs[index++];
-          appendln("  {} {}, {}", mov, src, mem.toString());
+          generate_tail_call(fn, std::get<5>(body[i]));
+        }
+        else if (fuses(body, i))
+        {
+          reserve(i + 1);
+          generate_fma(std::get<3>(body[i]), std::get<3>(body[i + 1]));
+          i++;
         }
         else
         {
-          Storage temp = make_temp(param.getType());
-          const std::string temp_form = temp.toString();
+          generate_instruction(body[i]);
+        }
+      }
 
-          appendln("  {} {}(%rbp), {}", mov, stack_params_offset, temp_form);
-          appendln("  {} {}, {}", mov, temp_form, mem.toString());
+      if (!tail)
+      {
+        reserve(body.size());
+        generate_terminator(fn.getTerminator());
+      }
 
-          stack_params_offset += param.getType().getByteSize();
+      // the rewrites that only need the machine code
+      if (options.opt_level >= 1)
+        peephole(machine);
+      if (options.opt_level >= 2)
+        schedule(machine, options.tune);
+
+      out += machine.toString();
+    }
+    // the constants go to the mergeable sections, the linker keeps one
+    // copy of the equal ones across all the objects
+    void generate_constants()
+    {
+      for (size_t size : { 4, 8 })
+      {
+        bool empty = true;
+        for (const auto& label : labels)
+        {
+          if (label.getData().front().getType().getByteSize() != size)
+            continue;
+
+          if (empty)
+          {
+            appendln("\n.section .rodata.cst{},\"aM\",@progbits,{}", size, size);
+            appendln(".p2align {}", std::countr_zero(size));
+            empty = false;
+          }
+          append("{}", label.toString());
         }
+      }
 
-        storage[param.getId()].setValue(mem);
+      if (!arrays.empty())
+        appendln("\n.section .rodata");
+      for (const auto& label : arrays)
+      {
+        appendln(".p2align 4");
+        append("{}", label.toString());
       }
     }
-    void generate_function(Function& fn)
+    // the globals that are stored to go to .data, or to .bss if they start
+    // at zero so they take no space in the object. The others go to .rodata
+    void generate_globals(const Program& program)
     {
-      if (!fn.isDefined())
-        return; // do nothing
+      std::unordered_set<std::string> written;
+      for (const auto& fn : program.getFunctions())
+      {
+        const auto globals = global_slots(fn);
+        // Store, StoreElement and InitArray
+        for (const auto& instruction : fn.getBody())
+          if (instruction.index() != 0 && globals.contains(getDestination(instruction).getId()))
+            written.insert(globals.at(getDestination(instruction).getId()));
+      }
 
-      size_t total_registers = fn.getTotalRegisters();
-      size_t capacity = storage.max_load_factor() * storage.bucket_count();
-      if (total_registers > capacity)
-        storage.reserve(total_registers - capacity);
+      auto is_zero = [](const std::vector<Constant>& init)
+      {
+        // -0.0 is not
+        return std::all_of(init.begin(), init.end(), [](const Constant& value) {
+          if (value.isFloatValue())
+            return std::bit_cast<uint64_t>(value.getFloatValue()) == 0;
 
-      const std::string& name = fn.getName();
-      appendln(".globl {}", name);
-      appendln(".type {}, @function", name);
-      appendln("{}:", name);
+          return value.getIntegerValue() == 0;
+        });
+      };
 
-      // prologue
-      appendln("  pushq %rbp");
-      appendln("  movq %rsp, %rbp");
-      offset = 0;
+      for (const std::string section : { ".data", ".bss", ".rodata" })
+      {
+        bool empty = true;
+        for (const auto& global : program.getGlobals())
+        {
+          const std::string& name = global.getName();
+          const bool zero = is_zero(global.getInit());
+          if (section != (!written.contains(name) ? ".rodata" : zero ? ".bss" : ".data"))
+            continue;
 
-      generate_params(fn.getParams());
+          if (empty)
+          {
+            appendln("\n.section {}", section);
+            empty = false;
+          }
 
-      auto& body = fn.getBody();
-      for (auto& instruction : body)
-        generate_instruction(instruction);
+          const size_t size = global.getType().getByteSize();
+          appendln(".globl {}", name);
+          appendln(".type {}, @object", name);
+          appendln(".size {}, {}", name, size);
+          appendln(".p2align {}", std::countr_zero(global.getType().getAlignment()));
 
-      generate_terminator(fn.getTerminator());
+          std::vector<Data> data;
+          for (const auto& value : global.getInit())
+            data.push_back(Data(value));
 
-      if (!labels.empty())
-        generate_data(labels);
+          if (section == ".bss")
+            append("{}:\n  .zero {}\n", name, size);
+          else
+            append("{}", DataLabel(name, std::move(data)).toString());
+        }
+      }
     }
-    std::string generate(Program& program)
+    std::string generate(Program& program, const Opts& opts)
     {
+      options = opts;
+
       appendln("# Program: {}", program.getName());
       appendln(".section .text\n");
 
       auto& functions = program.getFunctions();
+      for (const auto& fn : functions)
+        if (fn.isDefined())
+          defined.insert(fn.getName());
+
       for (auto& fn : functions)
         generate_function(fn);
 
+      generate_globals(program);
+      generate_constants();
+
+      if (options.stats)
+        std::println(stderr, "  {} array copies unrolled, {} through a loop", unrolled_copies, copy_loops);
+
       return out;
     }
   }
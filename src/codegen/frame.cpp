@@ -0,0 +1,156 @@
+#include "codegen/frame.h"
+#include <algorithm>
+#include <numeric>
+
+namespace soft {
+  namespace codegen {
+    size_t align_to(size_t value, size_t alignment)
+    {
+      return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool is_tail_call(const Function& fn)
+    {
+      const auto& body = fn.getBody();
+      if (body.empty() || body.back().index() != 5 || !fn.isTerminated()) // Call
+        return false;
+
+      const auto& call = std::get<5>(body.back());
+      const Value& value = fn.getTerminator().getValue();
+      if (!value.isSlot() || value.getSlot().getId() != call.getDst().getId())
+        return false;
+
+      std::vector<Type> types;
+      for (const auto& arg : call.getArgs())
+        types.push_back(arg.getType());
+
+      auto registers = argument_registers(types);
+      return std::all_of(registers.begin(), registers.end(), [](const auto& reg) { return reg.has_value(); });
+    }
+    bool is_leaf(const Function& fn)
+    {
+      const auto& body = fn.getBody();
+      size_t calls = std::count_if(body.begin(), body.end(), [](const Instruction& instruction) {
+        return instruction.index() == 5; // Call
+      });
+
+      return calls == 0 || (calls == 1 && is_tail_call(fn));
+    }
+
+    std::vector<StackObject> stack_objects(const Function& fn, const std::vector<Interval>& intervals, const std::unordered_map<size_t, Storage>& allocation)
+    {
+      std::vector<StackObject> objects;
+      // slot id -> index in `objects`
+      std::unordered_map<size_t, size_t> index;
+
+      auto access = [&](size_t id, size_t position)
+      {
+        auto it = index.find(id);
+        if (it != index.end())
+          objects[it->second].end = position;
+      };
+
+      // the parameters passed in registers that are stored to, the prologue
+      // copies them to the frame. The others have an interval or stay where
+      // the caller put them
+      const auto& params = fn.getParams();
+      std::vector<Type> types;
+      for (const auto& param : params)
+        types.push_back(param.getType());
+
+      auto incoming = argument_registers(types);
+      for (size_t i = 0; i < params.size(); ++i)
+      {
+        if (!incoming[i].has_value() || allocation.contains(params[i].getId()))
+          continue;
+
+        index[params[i].getId()] = objects.size();
+        objects.push_back({ params[i].getId(), params[i].getType(), 0, 0 });
+      }
+
+      const auto& body = fn.getBody();
+      for (size_t i = 0; i < body.size(); ++i)
+      {
+        for (const Value* value : getOperands(body[i]))
+          if (value->isSlot())
+            access(value->getSlot().getId(), i);
+
+        const Slot& dst = getDestination(body[i]);
+        // the globals are not in the frame
+        if (body[i].index() == 0 && !std::get<0>(body[i]).isGlobal()) // Alloca
+        {
+          index[dst.getId()] = objects.size();
+          objects.push_back({ dst.getId(), dst.getType(), i, i });
+        }
+        // Store, StoreElement and InitArray, the temporaries have no object
+        else
+          access(dst.getId(), i);
+      }
+
+      if (fn.isTerminated() && fn.getTerminator().getValue().isSlot())
+        access(fn.getTerminator().getValue().getSlot().getId(), body.size());
+
+      // the temporaries that didn't get a register
+      for (const Interval& interval : intervals)
+      {
+        auto it = allocation.find(interval.slot.getId());
+        if (it != allocation.end() && it->second.isMemory())
+          objects.push_back({ interval.slot.getId(), interval.slot.getType(), interval.start, interval.end });
+      }
+
+      return objects;
+    }
+
+    size_t layout_frame(std::vector<StackObject>& objects)
+    {
+      // the biggest objects first so the scalars are aligned to their
+      // slot and need no padding
+      std::vector<size_t> order(objects.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return objects[a].type.getByteSize() > objects[b].type.getByteSize();
+      });
+
+      // NOTE: the bounds are inclusive since an instruction may read
+      // an object while it writes another one
+      auto overlap = [](const StackObject& a, const StackObject& b)
+      {
+        return a.start <= b.end && b.start <= a.end;
+      };
+
+      // every color is a stack slot, the smaller objects fit in
+      // the slot of a bigger one
+      std::vector<std::vector<size_t>> colors;
+      for (size_t i : order)
+      {
+        auto color = std::find_if(colors.begin(), colors.end(), [&](const std::vector<size_t>& members) {
+          return std::none_of(members.begin(), members.end(), [&](size_t member) {
+            return overlap(objects[member], objects[i]);
+          });
+        });
+
+        if (color == colors.end())
+          colors.push_back({ i });
+        else
+          color->push_back(i);
+      }
+
+      size_t size = 0;
+      for (const auto& members : colors)
+      {
+        // an array is aligned to its elements, the slot to its strictest member
+        const size_t slot_size = objects[members.front()].type.getByteSize();
+        size_t alignment = 1;
+        for (size_t member : members)
+          alignment = std::max(alignment, objects[member].type.getAlignment());
+
+        size = align_to(size + slot_size, alignment);
+
+        for (size_t member : members)
+          objects[member].offset = size;
+      }
+
+      return align_to(size, 16);
+    }
+  }
+}
@@ -0,0 +1,431 @@
+#include "codegen/machine.h"
+#include "common.h"
+
+namespace soft {
+  namespace codegen {
+    char suffix(const Type& type)
+    {
+      if (type.isFloatingPoint())
+      {
+        switch (type.getByteSize())
+        {
+          case 4: return 's';
+          case 8: return 'd';
+        }
+      }
+      else
+      {
+        switch (type.getByteSize())
+        {
+          case 1: return 'b';
+          case 2: return 'w';
+          case 4: return 'l';
+          case 8: return 'q';
+        }
+      }
+      unreachable();
+    }
+
+    Immediate::Immediate(int64_t value)
+      : value(value) {}
+    Immediate::Immediate() = default;
+
+    int64_t Immediate::getValue() const { return this->value; }
+
+    void Immediate::setValue(int64_t value) { this->value = value; }
+
+    std::string Immediate::toString() const
+    {
+      return std::format("${}", this->value);
+    }
+
+    Symbol::Symbol(std::string name)
+      : name(std::move(name)) {}
+    Symbol::Symbol(Type type, std::string name)
+      : type(std::move(type)), name(std::move(name)) {}
+    Symbol::Symbol() = default;
+
+    bool Symbol::isData() const { return this->type.has_value(); }
+
+    Type& Symbol::getType() { return *this->type; }
+    const Type& Symbol::getType() const { return *this->type; }
+    const std::string& Symbol::getName() const { return this->name; }
+
+    void Symbol::setType(Type type) { this->type = std::move(type); }
+    void Symbol::setName(std::string name) { this->name = std::move(name); }
+
+    std::string Symbol::toString() const
+    {
+      if (isData())
+        return std::format("{}(%rip)", this->name);
+
+      return this->name;
+    }
+
+    Operand::Operand(Register value)
+      : value(std::move(value)) {}
+    Operand::Operand(Memory value)
+      : value(std::move(value)) {}
+    Operand::Operand(Immediate value)
+      : value(std::move(value)) {}
+    Operand::Operand(Symbol value)
+      : value(std::move(value)) {}
+    Operand::Operand(Storage value)
+    {
+      if (value.isRegister())
+        this->value = value.getRegister();
+      else
+        this->value = value.getMemory();
+    }
+    Operand::Operand() = default;
+
+    bool Operand::isRegister() const { return getIndex() == 0; }
+    bool Operand::isMemory() const { return getIndex() == 1; }
+    bool Operand::isImmediate() const { return getIndex() == 2; }
+    bool Operand::isSymbol() const { return getIndex() == 3; }
+    size_t Operand::getIndex() const { return this->value.index(); }
+
+    Register& Operand::getRegister() { return std::get<0>(this->value); }
+    Memory& Operand::getMemory() { return std::get<1>(this->value); }
+    Immediate& Operand::getImmediate() { return std::get<2>(this->value); }
+    Symbol& Operand::getSymbol() { return std::get<3>(this->value); }
+    const Type& Operand::getType() const
+    {
+      if (isRegister()) return getRegister().getType();
+      else if (isMemory()) return getMemory().getType();
+      else if (isSymbol()) return getSymbol().getType();
+
+      unreachable();
+    }
+
+    const Register& Operand::getRegister() const { return std::get<0>(this->value); }
+    const Memory& Operand::getMemory() const { return std::get<1>(this->value); }
+    const Immediate& Operand::getImmediate() const { return std::get<2>(this->value); }
+    const Symbol& Operand::getSymbol() const { return std::get<3>(this->value); }
+
+    std::vector<Register::Knd> Operand::getRegisters() const
+    {
+      if (isRegister())
+        return { getRegister().getKnd() };
+
+      // %rip is not allocated
+      if (isMemory() && getMemory().getSymbol().has_value())
+        return {};
+
+      if (isMemory())
+      {
+        std::vector<Register::Knd> result = { getMemory().getBase() };
+        if (getMemory().getIndex().has_value())
+          result.push_back(*getMemory().getIndex());
+        return result;
+      }
+
+      return {};
+    }
+
+    std::string Operand::toString() const
+    {
+      switch (getIndex())
+      {
+        case 0: return getRegister().toString();
+        case 1: return getMemory().toString();
+        case 2: return getImmediate().toString();
+        case 3: return getSymbol().toString();
+      }
+      unreachable();
+    }
+
+    MachineInstruction::MachineInstruction(Opcode opcode, std::vector<Operand> operands)
+      : opcode(opcode), operands(std::move(operands)) {}
+    MachineInstruction::MachineInstruction() = default;
+
+    MachineInstruction::Opcode MachineInstruction::getOpcode() const { return this->opcode; }
+    std::vector<Operand>& MachineInstruction::getOperands() { return this->operands; }
+    const std::vector<Operand>& MachineInstruction::getOperands() const { return this->operands; }
+
+    void MachineInstruction::setOpcode(Opcode opcode) { this->opcode = opcode; }
+    void MachineInstruction::setOperands(std::vector<Operand> operands) { this->operands = std::move(operands); }
+
+    // the one operand multiplications and divisions work on rdx:rax
+    bool is_wide(MachineInstruction::Opcode opcode, size_t operands)
+    {
+      using Opcode = MachineInstruction::Opcode;
+      return operands == 1 && (opcode == Opcode::Imul || opcode == Opcode::Mul || opcode == Opcode::Div || opcode == Opcode::Idiv);
+    }
+
+    std::vector<Register::Knd> MachineInstruction::getUses() const
+    {
+      using Knd = Register::Knd;
+      std::vector<Register::Knd> result;
+
+      switch (this->opcode)
+      {
+        case Opcode::Cqto: case Opcode::Cltd:
+          return { Knd::RAX };
+        case Opcode::RepMovsb:
+          return { Knd::RDI, Knd::RSI, Knd::RCX };
+        // what a function leaves for its caller
+        case Opcode::Ret:
+          return {
+            Knd::RAX, Knd::RDX, Knd::XMM0, Knd::XMM1, Knd::RBX, Knd::RBP,
+            Knd::RSP, Knd::R12, Knd::R13, Knd::R14, Knd::R15,
+          };
+        case Opcode::Push: case Opcode::Pop: case Opcode::Leave:
+          result = { Knd::RSP, Knd::RBP };
+          break;
+        case Opcode::Call: case Opcode::Jmp:
+          result = { Knd::RDI, Knd::RSI, Knd::RDX, Knd::RCX, Knd::R8, Knd::R9, Knd::RSP };
+          for (int knd = static_cast<int>(Knd::XMM0); knd <= static_cast<int>(Knd::XMM7); ++knd)
+            result.push_back(static_cast<Knd>(knd));
+          break;
+        default:
+          break;
+      }
+
+      for (size_t i = 0; i < this->operands.size(); ++i)
+      {
+        const Operand& operand = this->operands[i];
+        // the destination register is only read when it's updated
+        bool destination = i + 1 == this->operands.size() && this->operands.size() > 1;
+        if (destination && operand.isRegister() && overwrites())
+          continue;
+
+        for (Register::Knd knd : operand.getRegisters())
+          result.push_back(knd);
+      }
+
+      if (is_wide(this->opcode, this->operands.size()))
+      {
+        result.push_back(Knd::RAX);
+        if (this->opcode == Opcode::Div || this->opcode == Opcode::Idiv)
+          result.push_back(Knd::RDX);
+      }
+
+      return result;
+    }
+    std::vector<Register::Knd> MachineInstruction::getDefs() const
+    {
+      using Knd = Register::Knd;
+
+      switch (this->opcode)
+      {
+        case Opcode::Cqto: case Opcode::Cltd:
+          return { Knd::RDX };
+        case Opcode::RepMovsb:
+          return { Knd::RDI, Knd::RSI, Knd::RCX };
+        case Opcode::Push:
+          return { Knd::RSP };
+        case Opcode::Pop: case Opcode::Leave:
+          return { Knd::RSP, Knd::RBP };
+        // the caller-saved registers
+        case Opcode::Call:
+        {
+          std::vector<Register::Knd> result = {
+            Knd::RAX, Knd::RCX, Knd::RDX, Knd::RSI, Knd::RDI,
+            Knd::R8, Knd::R9, Knd::R10, Knd::R11,
+          };
+          for (int knd = static_cast<int>(Knd::XMM0); knd <= static_cast<int>(Knd::XMM15); ++knd)
+            result.push_back(static_cast<Knd>(knd));
+          return result;
+        }
+        case Opcode::Jmp: case Opcode::Ret: case Opcode::Label:
+          return {};
+        default:
+          break;
+      }
+
+      if (is_wide(this->opcode, this->operands.size()))
+        return { Knd::RAX, Knd::RDX };
+
+      if (!this->operands.empty() && this->operands.back().isRegister())
+        return { this->operands.back().getRegister().getKnd() };
+
+      return {};
+    }
+    bool MachineInstruction::overwrites() const
+    {
+      if (this->operands.size() < 2 || !this->operands.back().isRegister())
+        return false;
+
+      const Operand& src = this->operands.front();
+      const Register& dst = this->operands.back().getRegister();
+
+      // the packed moves write the whole register, the two operand
+      // arithmetic reads it
+      if (dst.getType().isVector())
+        return this->opcode == Opcode::Mov || this->operands.size() == 3;
+
+      // the scalar SSE instructions keep the upper part of the
+      // register unless they load from memory, the VEX ones copy
+      // it from their first source
+      if (dst.getType().isFloatingPoint())
+      {
+        switch (this->opcode)
+        {
+          case Opcode::Mov:
+            return src.isMemory() || src.isSymbol();
+          case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div:
+            return this->operands.size() == 3;
+          default:
+            return false;
+        }
+      }
+
+      // the 8 and 16-bit writes keep the upper part too
+      if (dst.getType().getByteSize() < 4)
+        return false;
+
+      switch (this->opcode)
+      {
+        case Opcode::Mov: case Opcode::Movabs: case Opcode::Movsx:
+        case Opcode::Movzx: case Opcode::Lea: case Opcode::Cvtts2si:
+        case Opcode::Movd:
+          return true;
+        // xor %r, %r
+        case Opcode::Xor:
+          return src.isRegister() && src.getRegister().getKnd() == dst.getKnd();
+        case Opcode::Imul:
+          return this->operands.size() == 3;
+        default:
+          return false;
+      }
+    }
+    bool MachineInstruction::writesFlags() const
+    {
+      switch (this->opcode)
+      {
+        case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div:
+          // the SSE arithmetic doesn't
+          return !uses_xmm(this->operands.back().getType());
+        case Opcode::Imul: case Opcode::Idiv: case Opcode::And: case Opcode::Xor:
+        case Opcode::Shl: case Opcode::Shr: case Opcode::Sar: case Opcode::Neg:
+          return true;
+        default:
+          return false;
+      }
+    }
+    bool MachineInstruction::isBarrier() const
+    {
+      switch (this->opcode)
+      {
+        case Opcode::Push: case Opcode::Pop: case Opcode::Leave: case Opcode::Call:
+        case Opcode::Jmp: case Opcode::Jne: case Opcode::Ret: case Opcode::Label:
+          return true;
+        // the memory it writes is not an operand
+        case Opcode::RepMovsb:
+          return true;
+        // the upper part of every ymm register
+        case Opcode::Vzeroupper:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    std::string MachineInstruction::toString() const
+    {
+      const auto& ops = this->operands;
+      // the operand size is the one of the destination, or the source's
+      // for the instructions that change it
+      auto sfx = [&](size_t i) { return suffix(ops[i].getType()); };
+      // the SSE arithmetic is `op` + s + s|d, v + `op` + s + s|d for VEX.
+      // the packed one is `op` + p + s|d for the floating points and
+      // p + `op` + b|w|d|q for the integers, the ymm registers are VEX only
+      auto arithmetic = [&](std::string op)
+      {
+        const Type& type = ops.back().getType();
+        if (type.isVector())
+        {
+          const Type& lane = type.getElement();
+          const char* v = ops.size() == 3 || type.getByteSize() == 32 ? "v" : "";
+          if (lane.isFloatingPoint())
+            return std::format("{}{}p{}", v, op == "mov" ? "movu" : op, suffix(lane));
+
+          static constexpr std::array<char, 9> lanes = { 0, 'b', 'w', 0, 'd', 0, 0, 0, 'q' };
+          if (op == "mov")
+            return std::format("{}movdqu", v);
+          return std::format("{}p{}{}", v, op == "mul" ? "mull" : op, lanes[lane.getByteSize()]);
+        }
+        if (!type.isFloatingPoint())
+          return std::format("{}{}", op, suffix(type));
+
+        return std::format("{}{}s{}", ops.size() == 3 ? "v" : "", op, suffix(type));
+      };
+
+      std::string mnemonic;
+      switch (this->opcode)
+      {
+        case Opcode::Mov:      mnemonic = arithmetic("mov"); break;
+        case Opcode::Movabs:   mnemonic = "movabsq"; break;
+        case Opcode::Movsx:    mnemonic = std::format("movs{}{}", sfx(0), sfx(1)); break;
+        case Opcode::Movzx:    mnemonic = std::format("movz{}{}", sfx(0), sfx(1)); break;
+        case Opcode::Lea:      mnemonic = arithmetic("lea"); break;
+        case Opcode::Add:      mnemonic = arithmetic("add"); break;
+        case Opcode::Sub:      mnemonic = arithmetic("sub"); break;
+        case Opcode::Imul:     mnemonic = arithmetic("imul"); break;
+        case Opcode::Mul:      mnemonic = arithmetic("mul"); break;
+        case Opcode::Div:      mnemonic = arithmetic("div"); break;
+        case Opcode::Idiv:     mnemonic = arithmetic("idiv"); break;
+        case Opcode::And:      mnemonic = arithmetic("and"); break;
+        case Opcode::Xor:      mnemonic = arithmetic("xor"); break;
+        case Opcode::Shl:      mnemonic = arithmetic("shl"); break;
+        case Opcode::Shr:      mnemonic = arithmetic("shr"); break;
+        case Opcode::Sar:      mnemonic = arithmetic("sar"); break;
+        case Opcode::Neg:      mnemonic = arithmetic("neg"); break;
+        case Opcode::Cqto:     mnemonic = "cqto"; break;
+        case Opcode::Cltd:     mnemonic = "cltd"; break;
+        case Opcode::Cvtsi2s:  mnemonic = std::format("cvtsi2s{}{}", sfx(1), sfx(0)); break;
+        case Opcode::Cvtts2si: mnemonic = std::format("cvtts{}2si", sfx(0)); break;
+        case Opcode::Cvts2s:   mnemonic = std::format("cvts{}2s{}", sfx(0), sfx(1)); break;
+        case Opcode::Fmadd:    mnemonic = std::format("vfmadd231s{}", sfx(2)); break;
+        case Opcode::Fmsub:    mnemonic = std::format("vfmsub231s{}", sfx(2)); break;
+        case Opcode::Fnmadd:   mnemonic = std::format("vfnmadd231s{}", sfx(2)); break;
+        case Opcode::Movups:   mnemonic = ops[1].getType().getByteSize() == 32 ? "vmovups" : "movups"; break;
+        case Opcode::Movd:     mnemonic = ops[1].getType().getByteSize() == 8 ? "movq" : "movd"; break;
+        case Opcode::Pshufd:   mnemonic = ops[2].getType().getByteSize() == 32 ? "vpshufd" : "pshufd"; break;
+        case Opcode::Vextractf128: mnemonic = "vextractf128"; break;
+        case Opcode::Vpermps:  mnemonic = "vpermps"; break;
+        case Opcode::RepMovsb: mnemonic = "rep movsb"; break;
+        case Opcode::Vzeroupper: mnemonic = "vzeroupper"; break;
+        case Opcode::Push:     mnemonic = "pushq"; break;
+        case Opcode::Pop:      mnemonic = "popq"; break;
+        case Opcode::Leave:    mnemonic = "leave"; break;
+        case Opcode::Call:     mnemonic = "callq"; break;
+        case Opcode::Jmp:      mnemonic = "jmp"; break;
+        case Opcode::Jne:      mnemonic = "jne"; break;
+        case Opcode::Ret:      mnemonic = "retq"; break;
+        case Opcode::Label:    return std::format("{}:", ops[0].toString());
+      }
+
+      std::string result = "  " + mnemonic;
+      for (size_t i = 0; i < ops.size(); ++i)
+        result += (i == 0 ? " " : ", ") + ops[i].toString();
+
+      return result;
+    }
+
+    MachineFunction::MachineFunction(std::string name)
+      : name(std::move(name)) {}
+    MachineFunction::MachineFunction() = default;
+
+    const std::string& MachineFunction::getName() const { return this->name; }
+    std::vector<MachineInstruction>& MachineFunction::getInstructions() { return this->instructions; }
+    const std::vector<MachineInstruction>& MachineFunction::getInstructions() const { return this->instructions; }
+
+    void MachineFunction::setName(std::string name) { this->name = std::move(name); }
+    void MachineFunction::setInstructions(std::vector<MachineInstruction> instructions) { this->instructions = std::move(instructions); }
+
+    std::string MachineFunction::toString() const
+    {
+      std::string result;
+      result += std::format(".globl {}\n", this->name);
+      result += std::format(".type {}, @function\n", this->name);
+      result += std::format("{}:\n", this->name);
+
+      for (const auto& instruction : this->instructions)
+        result += instruction.toString() + "\n";
+
+      return result;
+    }
+  }
+}
@@ -0,0 +1,102 @@
+#include "codegen/magic.h"
+
+namespace soft {
+  namespace codegen {
+    SignedMagic signed_magic(int64_t divisor, size_t bitwidth)
+    {
+      // all the arithmetic is done on `bitwidth` unsigned bits
+      const uint64_t mask = bitwidth == 64 ? ~0ULL : (1ULL << bitwidth) - 1;
+      const uint64_t two_w1 = 1ULL << (bitwidth - 1);
+
+      uint64_t d = (uint64_t) divisor & mask;
+      uint64_t ad = (divisor < 0 ? -(uint64_t) divisor : (uint64_t) divisor) & mask;
+      uint64_t t = two_w1 + (d >> (bitwidth - 1));
+      uint64_t anc = t - 1 - t % ad; // absolute value of nc
+      size_t p = bitwidth - 1;
+
+      uint64_t q1 = two_w1 / anc;
+      uint64_t r1 = two_w1 - q1 * anc;
+      uint64_t q2 = two_w1 / ad;
+      uint64_t r2 = two_w1 - q2 * ad;
+      uint64_t delta;
+
+      do {
+        p++;
+        q1 = (2 * q1) & mask;
+        r1 = (2 * r1) & mask;
+        if (r1 >= anc)
+        {
+          q1 = (q1 + 1) & mask;
+          r1 = (r1 - anc) & mask;
+        }
+
+        q2 = (2 * q2) & mask;
+        r2 = (2 * r2) & mask;
+        if (r2 >= ad)
+        {
+          q2 = (q2 + 1) & mask;
+          r2 = (r2 - ad) & mask;
+        }
+
+        delta = ad - r2;
+      } while (q1 < delta || (q1 == delta && r1 == 0));
+
+      uint64_t multiplier = (q2 + 1) & mask;
+      if (divisor < 0)
+        multiplier = -multiplier & mask;
+
+      // sign extend it back to 64 bits
+      if (bitwidth < 64 && (multiplier & two_w1))
+        multiplier |= ~mask;
+
+      return { (int64_t) multiplier, p - bitwidth };
+    }
+    UnsignedMagic unsigned_magic(uint64_t divisor, size_t bitwidth)
+    {
+      const uint64_t mask = bitwidth == 64 ? ~0ULL : (1ULL << bitwidth) - 1;
+      const uint64_t two_w1 = 1ULL << (bitwidth - 1);
+
+      uint64_t d = divisor & mask;
+      uint64_t nc = (mask - ((mask + 1 - d) & mask) % d) & mask;
+      size_t p = bitwidth - 1;
+      bool add = false;
+
+      uint64_t q1 = two_w1 / nc;
+      uint64_t r1 = two_w1 - q1 * nc;
+      uint64_t q2 = (two_w1 - 1) / d;
+      uint64_t r2 = (two_w1 - 1) - q2 * d;
+      uint64_t delta;
+
+      do {
+        p++;
+        if (r1 >= ((nc - r1) & mask))
+        {
+          q1 = (2 * q1 + 1) & mask;
+          r1 = (2 * r1 - nc) & mask;
+        }
+        else
+        {
+          q1 = (2 * q1) & mask;
+          r1 = (2 * r1) & mask;
+        }
+
+        if (((r2 + 1) & mask) >= ((d - r2) & mask))
+        {
+          if (q2 >= two_w1 - 1) add = true;
+          q2 = (2 * q2 + 1) & mask;
+          r2 = (2 * r2 + 1 - d) & mask;
+        }
+        else
+        {
+          if (q2 >= two_w1) add = true;
+          q2 = (2 * q2) & mask;
+          r2 = (2 * r2 + 1) & mask;
+        }
+
+        delta = (d - 1 - r2) & mask;
+      } while (p < 2 * bitwidth && (q1 < delta || (q1 == delta && r1 == 0)));
+
+      return { (q2 + 1) & mask, p - bitwidth, add };
+    }
+  }
+}
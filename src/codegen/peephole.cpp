@@ -0,0 +1,285 @@
+#include "codegen/peephole.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace soft {
+  namespace codegen {
+    using Opcode = MachineInstruction::Opcode;
+
+    bool contains(const std::vector<Register::Knd>& registers, Register::Knd reg)
+    {
+      return std::find(registers.begin(), registers.end(), reg) != registers.end();
+    }
+    bool is_integer_register(const Operand& operand)
+    {
+      return operand.isRegister() && operand.getType().isInteger();
+    }
+    bool same_register(const Operand& a, const Operand& b)
+    {
+      return a.isRegister() && b.isRegister() && a.getRegister().getKnd() == b.getRegister().getKnd();
+    }
+
+    // returns true if the register isn't read after the instruction at
+    // `position` before it's overwritten, the unknown cases count as read
+    bool is_dead(const std::vector<MachineInstruction>& code, size_t position, Register::Knd reg)
+    {
+      for (size_t i = position + 1; i < code.size(); ++i)
+      {
+        const MachineInstruction& instruction = code[i];
+        if (instruction.getOpcode() == Opcode::Ret)
+          return !contains(instruction.getUses(), reg);
+        if (instruction.isBarrier() || contains(instruction.getUses(), reg))
+          return false;
+
+        if (!contains(instruction.getDefs(), reg))
+          continue;
+
+        // the implicit destinations (rdx:rax) are always written whole
+        const auto& operands = instruction.getOperands();
+        bool implicit = operands.empty() || !operands.back().isRegister() || operands.back().getRegister().getKnd() != reg;
+        return implicit || instruction.overwrites();
+      }
+
+      return false;
+    }
+
+    // mov %a, %a
+    bool is_self_move(const MachineInstruction& instruction)
+    {
+      const auto& operands = instruction.getOperands();
+      if (instruction.getOpcode() != Opcode::Mov || !same_register(operands[0], operands[1]))
+        return false;
+
+      // movl also clears the upper half of the register
+      const Type& type = operands[1].getType();
+      return type.isFloatingPoint() || type.getBitwidth() != 32;
+    }
+    // returns true if the instruction writes a 32-bit register it names,
+    // which clears its upper half
+    bool clears_upper(const MachineInstruction& instruction)
+    {
+      const auto& operands = instruction.getOperands();
+      if (operands.empty() || !is_integer_register(operands.back()) || operands.back().getType().getBitwidth() != 32)
+        return false;
+      return contains(instruction.getDefs(), operands.back().getRegister().getKnd());
+    }
+    // mov a, b; mov b, a
+    bool is_round_trip(const MachineInstruction& first, const MachineInstruction& second)
+    {
+      if (first.getOpcode() != Opcode::Mov || second.getOpcode() != Opcode::Mov)
+        return false;
+
+      const Operand& a = first.getOperands()[0];
+      const Operand& b = first.getOperands()[1];
+      if (a.isImmediate() || (!a.isRegister() && !b.isRegister()))
+        return false;
+      if (second.getOperands()[0].toString() != b.toString() || second.getOperands()[1].toString() != a.toString())
+        return false;
+      // the xmm registers have the same name whatever is loaded in them,
+      // a scalar store doesn't hold a whole vector
+      if (second.getOperands()[1].getType().getBitwidth() != b.getType().getBitwidth())
+        return false;
+
+      // loading back with movl would clear the upper half
+      if (a.isRegister() && a.getType().isInteger(32))
+        return false;
+      // the address changed
+      if (b.isRegister() && contains(a.getRegisters(), b.getRegister().getKnd()))
+        return false;
+
+      return true;
+    }
+    // mov mem, %r; op %r, %d -> op mem, %d
+    // mov mem, %r; op %r, %s, %d -> op mem, %s, %d
+    bool fold_load(std::vector<MachineInstruction>& code, size_t position)
+    {
+      MachineInstruction& load = code[position];
+      MachineInstruction& op = code[position + 1];
+
+      if (load.getOpcode() != Opcode::Mov || op.getOperands().size() < 2)
+        return false;
+
+      const Operand& mem = load.getOperands()[0];
+      if (!mem.isMemory() && !mem.isSymbol())
+        return false;
+
+      switch (op.getOpcode())
+      {
+        case Opcode::Add: case Opcode::Sub: case Opcode::And:
+        case Opcode::Xor: case Opcode::Imul: case Opcode::Mul:
+        case Opcode::Div: case Opcode::Fmadd: case Opcode::Fmsub:
+        case Opcode::Fnmadd:
+          break;
+        default:
+          return false;
+      }
+
+      const Operand& reg = load.getOperands()[1];
+      const Operand& src = op.getOperands()[0];
+      const Operand& dst = op.getOperands().back();
+      if (!same_register(reg, src) || !dst.isRegister() || same_register(reg, dst))
+        return false;
+      // the VEX forms read it twice
+      if (op.getOperands().size() == 3 && same_register(reg, op.getOperands()[1]))
+        return false;
+
+      // the same width
+      if (reg.getType().getBitwidth() != src.getType().getBitwidth())
+        return false;
+      // the packed SSE arithmetic faults on unaligned memory, only
+      // the VEX one doesn't
+      if (reg.getType().isVector() && op.getOperands().size() == 2)
+        return false;
+
+      Register::Knd knd = reg.getRegister().getKnd();
+      if (contains(mem.getRegisters(), knd) || !is_dead(code, position + 1, knd))
+        return false;
+
+      op.getOperands()[0] = mem;
+      code.erase(code.begin() + position);
+      return true;
+    }
+    // shl $k, %i; add %i, %b -> lea (%b, %i, 2^k), %b
+    // mov %a, %d; add %b, %d -> lea (%a, %b), %d
+    // mov %a, %d; add $k, %d -> lea k(%a), %d
+    // NOTE: only the `jne` of the array copy loops reads the flags (there
+    // are no comparisons), `lea` not setting them doesn't matter elsewhere
+    bool form_lea(std::vector<MachineInstruction>& code, size_t position)
+    {
+      MachineInstruction& first = code[position];
+      MachineInstruction& add = code[position + 1];
+      if (add.getOpcode() != Opcode::Add || first.getOperands().size() != 2)
+        return false;
+      if (position + 2 < code.size() && code[position + 2].getOpcode() == Opcode::Jne)
+        return false;
+
+      const Operand& a = first.getOperands()[0];
+      const Operand& r = first.getOperands()[1];
+      const Operand& b = add.getOperands()[0];
+      const Operand& d = add.getOperands()[1];
+
+      // there's no 8-bit lea and the 16-bit one is slow, a narrower
+      // first instruction cut the upper bits the addition would read
+      if (!is_integer_register(r) || !is_integer_register(d) || r.getType().getBitwidth() < 32
+          || d.getType().getBitwidth() != r.getType().getBitwidth())
+        return false;
+
+      const Register::Knd rsp = Register::Knd::RSP;
+      const Type& type = d.getType();
+
+      if (first.getOpcode() == Opcode::Shl && a.isImmediate() && same_register(b, r) && !same_register(r, d))
+      {
+        int64_t k = a.getImmediate().getValue();
+        Register::Knd index = r.getRegister().getKnd();
+        if (k < 1 || k > 3 || index == rsp || !is_dead(code, position + 1, index))
+          return false;
+
+        add = MachineInstruction(Opcode::Lea, { Memory(type, 0, d.getRegister().getKnd(), index, 1 << k), d });
+        code.erase(code.begin() + position);
+        return true;
+      }
+
+      if (first.getOpcode() == Opcode::Mov && is_integer_register(a) && same_register(r, d) && !same_register(b, r))
+      {
+        Register::Knd base = a.getRegister().getKnd();
+        if (b.isImmediate() && b.getImmediate().getValue() != 0)
+          add = MachineInstruction(Opcode::Lea, { Memory(type, b.getImmediate().getValue(), base), d });
+        else if (is_integer_register(b) && b.getRegister().getKnd() != rsp)
+          add = MachineInstruction(Opcode::Lea, { Memory(type, 0, base, b.getRegister().getKnd(), 1), d });
+        else
+          return false;
+
+        code.erase(code.begin() + position);
+        return true;
+      }
+
+      return false;
+    }
+    // mov $0, %r -> xor %r, %r, the flags aren't read past the next
+    // arithmetic (see `form_lea()`)
+    bool zero_idiom(MachineInstruction& instruction)
+    {
+      const auto& operands = instruction.getOperands();
+      if (instruction.getOpcode() != Opcode::Mov || !operands[0].isImmediate() || operands[0].getImmediate().getValue() != 0)
+        return false;
+      if (!is_integer_register(operands[1]) || operands[1].getType().getBitwidth() < 32)
+        return false;
+
+      // the 32-bit form clears the whole register and is shorter
+      Register reg(Type(Type::Knd::Integer, 32), operands[1].getRegister().getKnd());
+      instruction = MachineInstruction(Opcode::Xor, { reg, reg });
+      return true;
+    }
+
+    void peephole(MachineFunction& fn)
+    {
+      auto& code = fn.getInstructions();
+
+      bool changed = true;
+      while (changed)
+      {
+        changed = false;
+
+        // the constant every register is known to hold
+        std::unordered_map<Register::Knd, std::string> constants;
+        // the registers whose upper half is known to be clear, their
+        // 32 -> 64 zero extension (`movl %eax, %eax`) is a no-op
+        std::unordered_set<Register::Knd> cleared;
+
+        for (size_t i = 0; i < code.size(); ++i)
+        {
+          MachineInstruction& instruction = code[i];
+          if (instruction.isBarrier())
+          {
+            constants.clear();
+            cleared.clear();
+            continue;
+          }
+
+          const auto& operands = instruction.getOperands();
+          bool constant = (instruction.getOpcode() == Opcode::Mov || instruction.getOpcode() == Opcode::Movabs)
+            && operands[0].isImmediate() && operands[1].isRegister();
+
+          bool extension = instruction.getOpcode() == Opcode::Mov && same_register(operands[0], operands[1])
+            && cleared.contains(operands[1].getRegister().getKnd());
+
+          if (is_self_move(instruction) || extension ||
+              (constant && constants[operands[1].getRegister().getKnd()] == instruction.toString()))
+          {
+            code.erase(code.begin() + i--);
+            changed = true;
+            continue;
+          }
+
+          for (Register::Knd knd : instruction.getDefs())
+          {
+            constants.erase(knd);
+            cleared.erase(knd);
+          }
+          if (clears_upper(instruction))
+            cleared.insert(operands.back().getRegister().getKnd());
+          if (constant)
+            constants[operands[1].getRegister().getKnd()] = instruction.toString();
+
+          if (i + 1 == code.size())
+            continue;
+
+          if (is_round_trip(instruction, code[i + 1]))
+          {
+            code.erase(code.begin() + i + 1);
+            changed = true;
+          }
+          else if (fold_load(code, i) || form_lea(code, i))
+          {
+            // the instruction at `i` is the rewritten one
+            i--;
+            changed = true;
+          }
+        }
+      }
+
+      for (auto& instruction : code)
+        zero_idiom(instruction);
+    }
+  }
+}
@@ -0,0 +1,623 @@
+#include "codegen/regalloc.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_set>
+
+namespace soft {
+  namespace codegen {
+    // the registers handed to the intervals, R10, R11, XMM14 and XMM15
+    // are kept for the temporaries of the instruction selection. The
+    // callee-saved ones come last since using them costs a save and a restore
+    static constexpr std::array<Register::Knd, 12> integer_registers = {
+      Register::Knd::RAX, Register::Knd::RCX, Register::Knd::RDX, Register::Knd::RSI,
+      Register::Knd::RDI, Register::Knd::R8, Register::Knd::R9, Register::Knd::RBX,
+      Register::Knd::R12, Register::Knd::R13, Register::Knd::R14, Register::Knd::R15,
+    };
+    static constexpr std::array<Register::Knd, 14> float_registers = {
+      Register::Knd::XMM0, Register::Knd::XMM1, Register::Knd::XMM2, Register::Knd::XMM3,
+      Register::Knd::XMM4, Register::Knd::XMM5, Register::Knd::XMM6, Register::Knd::XMM7,
+      Register::Knd::XMM8, Register::Knd::XMM9, Register::Knd::XMM10, Register::Knd::XMM11,
+      Register::Knd::XMM12, Register::Knd::XMM13,
+    };
+
+    // the integer registers, %rbp is one of them when
+    // the function doesn't need a frame pointer
+    std::vector<Register::Knd> allocatable_integers(bool frame_pointer)
+    {
+      std::vector<Register::Knd> registers(integer_registers.begin(), integer_registers.end());
+      if (!frame_pointer)
+        registers.push_back(Register::Knd::RBP);
+
+      return registers;
+    }
+
+    bool isFloat(Register::Knd knd)
+    {
+      return static_cast<int>(knd) >= static_cast<int>(Register::Knd::XMM0);
+    }
+    bool isTemporary(const Instruction& instruction)
+    {
+      // Convert, BinOp, UnOp, LoadElement, Shuffle and the calls that return a value
+      return ((instruction.index() >= 2 && instruction.index() <= 6) || instruction.index() == 9) && !getDestination(instruction).getType().isVoid();
+    }
+
+    // returns true if the value must survive the instruction
+    // at `position`, so the registers it overwrites can't hold it
+    bool live_across(const Interval& interval, size_t position)
+    {
+      // the parameters are defined before the first instruction
+      if (interval.incoming.has_value())
+        return position < interval.end;
+
+      return position > interval.start && position < interval.end;
+    }
+
+    std::vector<std::optional<Register::Knd>> argument_registers(const std::vector<Type>& types)
+    {
+      static constexpr std::array<Register::Knd, 6> integer_arguments = {
+        Register::Knd::RDI, Register::Knd::RSI, Register::Knd::RDX,
+        Register::Knd::RCX, Register::Knd::R8, Register::Knd::R9
+      };
+      static constexpr std::array<Register::Knd, 8> float_arguments = {
+        Register::Knd::XMM0, Register::Knd::XMM1, Register::Knd::XMM2, Register::Knd::XMM3,
+        Register::Knd::XMM4, Register::Knd::XMM5, Register::Knd::XMM6, Register::Knd::XMM7
+      };
+
+      size_t integer_index = 0;
+      size_t float_index = 0;
+
+      std::vector<std::optional<Register::Knd>> result;
+      for (const Type& type : types)
+      {
+        if (uses_xmm(type) && float_index < float_arguments.size())
+          result.push_back(float_arguments[float_index++]);
+        else if (!uses_xmm(type) && integer_index < integer_arguments.size())
+          result.push_back(integer_arguments[integer_index++]);
+        else if (type.isVector())
+        {
+          std::println("Vectors can only be passed in the first 8 xmm registers");
+          exit(1);
+        }
+        else
+          result.push_back(std::nullopt);
+      }
+
+      return result;
+    }
+
+    std::vector<Interval> live_intervals(const Function& fn)
+    {
+      std::vector<Interval> intervals;
+      // slot id -> index in `intervals`
+      std::unordered_map<size_t, size_t> index;
+
+      const auto& params = fn.getParams();
+      const auto& body = fn.getBody();
+
+      // the parameters that are stored to live in memory
+      std::unordered_set<size_t> stored;
+      for (const auto& instruction : body)
+        if (instruction.index() == 1) // Store
+          stored.insert(getDestination(instruction).getId());
+
+      std::vector<Type> types;
+      for (const auto& param : params)
+        types.push_back(param.getType());
+
+      auto incoming = argument_registers(types);
+      for (size_t i = 0; i < params.size(); ++i)
+      {
+        if (!incoming[i].has_value() || stored.contains(params[i].getId()))
+          continue;
+
+        index[params[i].getId()] = intervals.size();
+        intervals.push_back({ params[i], 0, 0, {}, std::nullopt, incoming[i] });
+      }
+
+      auto read = [&](const Value& value, size_t position)
+      {
+        if (!value.isSlot())
+          return;
+
+        auto it = index.find(value.getSlot().getId());
+        if (it == index.end())
+          return; // a variable
+
+        Interval& interval = intervals[it->second];
+        interval.end = position;
+        interval.uses.push_back(position);
+      };
+
+      for (size_t i = 0; i < body.size(); ++i)
+      {
+        std::optional<size_t> hint;
+        for (const Value* value : getOperands(body[i]))
+        {
+          read(*value, i);
+          if (!hint.has_value() && value->isSlot() && index.contains(value->getSlot().getId()))
+            hint = value->getSlot().getId();
+        }
+
+        if (!isTemporary(body[i]))
+          continue;
+
+        const Slot& dst = getDestination(body[i]);
+        index[dst.getId()] = intervals.size();
+        intervals.push_back({ dst, i, i, {}, hint });
+      }
+
+      if (fn.isTerminated())
+        read(fn.getTerminator().getValue(), body.size());
+
+      return intervals;
+    }
+    bool uses_rep_movsb(const InitArray& init)
+    {
+      return init.getDst().getType().getByteSize() > 2048;
+    }
+    std::vector<Register::Knd> clobbers(const Instruction& instruction)
+    {
+      if (instruction.index() == 8 && uses_rep_movsb(std::get<8>(instruction))) // InitArray
+        return { Register::Knd::RDI, Register::Knd::RSI, Register::Knd::RCX };
+
+      // everything the callee doesn't have to preserve (SysV)
+      if (instruction.index() == 5) // Call
+      {
+        std::vector<Register::Knd> registers = {
+          Register::Knd::RAX, Register::Knd::RCX, Register::Knd::RDX, Register::Knd::RSI,
+          Register::Knd::RDI, Register::Knd::R8, Register::Knd::R9, Register::Knd::R10,
+          Register::Knd::R11,
+        };
+        for (int knd = static_cast<int>(Register::Knd::XMM0); knd <= static_cast<int>(Register::Knd::XMM15); ++knd)
+          registers.push_back(static_cast<Register::Knd>(knd));
+
+        return registers;
+      }
+
+      if (instruction.index() != 3) // BinOp
+        return {};
+
+      const auto& binop = std::get<3>(instruction);
+      const Type& type = binop.getDst().getType();
+      if (!type.isInteger() || (binop.getOp() != BinOp::Op::Div && binop.getOp() != BinOp::Op::Mod))
+        return {};
+
+      // the powers of two are shifted in place, everything
+      // else needs rax and rdx (same check as the codegen)
+      const Value& right = binop.getRight();
+      if (right.isConstant())
+      {
+        int64_t divisor = right.getConstant().getIntegerValue();
+        uint64_t magnitude = type.isSigned() && divisor < 0 ? -(uint64_t) divisor : (uint64_t) divisor;
+        if (type.getBitwidth() <= 32)
+          magnitude &= 0xFFFFFFFF;
+
+        if (magnitude != 0 && (magnitude & (magnitude - 1)) == 0)
+          return {};
+      }
+
+      return { Register::Knd::RAX, Register::Knd::RDX };
+    }
+
+    // the slots the destination can share a register with to save the
+    // two operand move, the operations that can swap their operands
+    // list both
+    std::vector<size_t> move_related(const Instruction& instruction)
+    {
+      std::vector<size_t> related;
+      auto add = [&](const Value& value) {
+        if (value.isSlot()) related.push_back(value.getSlot().getId());
+      };
+
+      switch (instruction.index())
+      {
+        case 2: // Convert
+        {
+          const auto& convert = std::get<2>(instruction);
+          if (convert.getSrc().getType().isInteger() && convert.getDst().getType().isInteger())
+            add(convert.getSrc());
+          break;
+        }
+        case 3: // BinOp
+        {
+          const auto& binop = std::get<3>(instruction);
+          add(binop.getLeft());
+          if (binop.getOp() == BinOp::Op::Add || binop.getOp() == BinOp::Op::Mul)
+            add(binop.getRight());
+          break;
+        }
+        case 4: // UnOp
+          add(std::get<4>(instruction).getOperand());
+          break;
+      }
+
+      return related;
+    }
+    // the fixed register the instruction leaves its result in
+    std::optional<Register::Knd> result_register(const Instruction& instruction)
+    {
+      if (instruction.index() == 5) // Call
+        return uses_xmm(getDestination(instruction).getType()) ? Register::Knd::XMM0 : Register::Knd::RAX;
+
+      if (clobbers(instruction).empty())
+        return std::nullopt;
+
+      // (i)div leaves the quotient in rax and the remainder in rdx,
+      // the multiply-high sequence does the opposite
+      const auto& binop = std::get<3>(instruction);
+      const bool quotient = binop.getOp() == BinOp::Op::Div;
+      if (binop.getRight().isConstant())
+        return quotient ? Register::Knd::RDX : Register::Knd::RAX;
+
+      return quotient ? Register::Knd::RAX : Register::Knd::RDX;
+    }
+
+    std::unordered_map<size_t, Storage> linear_scan(const Function& fn, const std::vector<Interval>& intervals, bool frame_pointer)
+    {
+      const auto integers = allocatable_integers(frame_pointer);
+
+      // the instructions that overwrite each register
+      std::unordered_map<int, std::vector<size_t>> clobbered;
+      const auto& body = fn.getBody();
+      for (size_t i = 0; i < body.size(); ++i)
+        for (Register::Knd knd : clobbers(body[i]))
+          clobbered[static_cast<int>(knd)].push_back(i);
+
+      // the interval can't use the register if it's overwritten
+      // while the value is still needed
+      auto blocked = [&](Register::Knd knd, const Interval& interval)
+      {
+        auto it = clobbered.find(static_cast<int>(knd));
+        if (it == clobbered.end())
+          return false;
+
+        return std::any_of(it->second.begin(), it->second.end(), [&](size_t position) {
+          return live_across(interval, position);
+        });
+      };
+      // the first read at or after `position`
+      auto next_use = [](const Interval& interval, size_t position)
+      {
+        for (size_t use : interval.uses)
+          if (use >= position)
+            return use;
+
+        return SIZE_MAX;
+      };
+
+      std::vector<const Interval*> order;
+      for (const auto& interval : intervals)
+        order.push_back(&interval);
+      std::stable_sort(order.begin(), order.end(), [](const Interval* a, const Interval* b) {
+        return a->start < b->start;
+      });
+
+      std::unordered_map<size_t, Storage> result;
+      std::unordered_map<size_t, Register::Knd> assigned;
+      // the intervals holding a register, ordered by start
+      std::vector<const Interval*> active;
+
+      auto spill = [&](const Interval& interval)
+      {
+        // `layout_frame()` gives the stack slot its offset
+        result[interval.slot.getId()] = Memory(interval.slot.getType(), 0);
+      };
+
+      for (const Interval* interval : order)
+      {
+        // the values read for the last time by the defining instruction can
+        // hand their register over, the parameters are all defined at once
+        if (!interval->incoming.has_value())
+          std::erase_if(active, [&](const Interval* other) { return other->end <= interval->start; });
+
+        const bool is_float = uses_xmm(interval->slot.getType());
+        auto available = [&](Register::Knd knd)
+        {
+          if (blocked(knd, *interval))
+            return false;
+
+          return std::none_of(active.begin(), active.end(), [&](const Interval* other) {
+            return assigned[other->slot.getId()] == knd;
+          });
+        };
+
+        std::optional<Register::Knd> choice;
+        if (interval->incoming.has_value() && available(*interval->incoming))
+          choice = interval->incoming;
+        else if (interval->hint.has_value())
+        {
+          auto it = assigned.find(*interval->hint);
+          if (it != assigned.end() && isFloat(it->second) == is_float && available(it->second))
+            choice = it->second;
+        }
+
+        if (!choice.has_value())
+        {
+          if (is_float)
+          {
+            for (Register::Knd knd : float_registers)
+              if (available(knd)) { choice = knd; break; }
+          }
+          else
+          {
+            for (Register::Knd knd : integers)
+              if (available(knd)) { choice = knd; break; }
+          }
+        }
+
+        // all taken: spill the value whose next read is the furthest away
+        if (!choice.has_value())
+        {
+          const Interval* victim = interval;
+          size_t furthest = next_use(*interval, interval->start + 1);
+
+          for (const Interval* other : active)
+          {
+            if (uses_xmm(other->slot.getType()) != is_float)
+              continue;
+
+            Register::Knd knd = assigned[other->slot.getId()];
+            if (blocked(knd, *interval))
+              continue;
+
+            size_t distance = next_use(*other, interval->start);
+            if (distance > furthest)
+            {
+              victim = other;
+              furthest = distance;
+            }
+          }
+
+          if (victim == interval)
+          {
+            spill(*interval);
+            continue;
+          }
+
+          choice = assigned[victim->slot.getId()];
+          assigned.erase(victim->slot.getId());
+          std::erase(active, victim);
+          spill(*victim);
+        }
+
+        assigned[interval->slot.getId()] = *choice;
+        active.push_back(interval);
+      }
+
+      for (const auto& interval : intervals)
+      {
+        auto it = assigned.find(interval.slot.getId());
+        if (it != assigned.end())
+          result[interval.slot.getId()] = Register(interval.slot.getType(), it->second);
+      }
+
+      return result;
+    }
+    std::unordered_map<size_t, Storage> graph_coloring(const Function& fn, const std::vector<Interval>& intervals, bool frame_pointer)
+    {
+      const auto integers = allocatable_integers(frame_pointer);
+
+      const auto& body = fn.getBody();
+      const size_t total = intervals.size();
+
+      // slot id -> node
+      std::unordered_map<size_t, size_t> node;
+      for (size_t i = 0; i < total; ++i)
+        node[intervals[i].slot.getId()] = i;
+
+      auto is_float = [&](size_t n) { return uses_xmm(intervals[n].slot.getType()); };
+      auto colors = [&](size_t n) { return is_float(n) ? float_registers.size() : integers.size(); };
+
+      // coalesced nodes point to the node that represents them
+      std::vector<size_t> alias(total);
+      std::iota(alias.begin(), alias.end(), 0);
+      auto find = [&](size_t n)
+      {
+        while (alias[n] != n)
+          n = alias[n] = alias[alias[n]];
+        return n;
+      };
+
+      // the interference graph, two temporaries of the same class interfere
+      // if one is defined while the other is still needed, the parameters
+      // are all defined at the same time
+      std::vector<std::unordered_set<size_t>> adjacent(total);
+      for (size_t a = 0; a < total; ++a)
+        for (size_t b = a + 1; b < total; ++b)
+        {
+          const Interval& x = intervals[a];
+          const Interval& y = intervals[b];
+          const bool params = x.incoming.has_value() && y.incoming.has_value();
+          if (is_float(a) == is_float(b) && (params || (x.start < y.end && y.start < x.end)))
+          {
+            adjacent[a].insert(b);
+            adjacent[b].insert(a);
+          }
+        }
+
+      // the registers overwritten while the value is needed
+      std::vector<std::unordered_set<Register::Knd>> forbidden(total);
+      for (size_t i = 0; i < body.size(); ++i)
+        for (Register::Knd knd : clobbers(body[i]))
+          for (size_t n = 0; n < total; ++n)
+            if (live_across(intervals[n], i))
+              forbidden[n].insert(knd);
+
+      // NOTE: the IR has no loops yet so every instruction is at depth 0,
+      // the weight of an access is 10^depth
+      std::vector<size_t> depth(body.size() + 1, 0);
+      std::vector<double> cost(total);
+      for (size_t n = 0; n < total; ++n)
+      {
+        cost[n] = std::pow(10.0, depth[intervals[n].start]);
+        for (size_t use : intervals[n].uses)
+          cost[n] += std::pow(10.0, depth[use]);
+      }
+
+      // the registers that save a move: where the parameters arrive, where
+      // the instruction leaves its result and where the function returns it
+      std::vector<std::optional<Register::Knd>> preferred(total);
+      for (size_t n = 0; n < total; ++n)
+        preferred[n] = intervals[n].incoming;
+      for (size_t i = 0; i < body.size(); ++i)
+        if (isTemporary(body[i]))
+          preferred[node[getDestination(body[i]).getId()]] = result_register(body[i]);
+
+      if (fn.isTerminated() && fn.getTerminator().getValue().isSlot())
+      {
+        auto it = node.find(fn.getTerminator().getValue().getSlot().getId());
+        if (it != node.end() && !preferred[it->second].has_value())
+          preferred[it->second] = is_float(it->second) ? Register::Knd::XMM0 : Register::Knd::RAX;
+      }
+
+      // conservative coalescing (Briggs): merge the move related nodes
+      // when the result has less than K neighbors of significant degree
+      for (size_t i = 0; i < body.size(); ++i)
+      {
+        if (!isTemporary(body[i]))
+          continue;
+
+        for (size_t id : move_related(body[i]))
+        {
+          auto it = node.find(id);
+          if (it == node.end())
+            continue; // a variable
+
+          size_t a = find(node[getDestination(body[i]).getId()]);
+          size_t b = find(it->second);
+          if (a == b || is_float(a) != is_float(b) || adjacent[a].contains(b))
+            continue;
+
+          std::unordered_set<size_t> neighbors = adjacent[a];
+          neighbors.insert(adjacent[b].begin(), adjacent[b].end());
+
+          size_t significant = std::count_if(neighbors.begin(), neighbors.end(), [&](size_t n) {
+            return adjacent[n].size() >= colors(n);
+          });
+          if (significant >= colors(a))
+            continue;
+
+          alias[b] = a;
+          for (size_t n : adjacent[b])
+          {
+            adjacent[n].erase(b);
+            adjacent[n].insert(a);
+            adjacent[a].insert(n);
+          }
+          adjacent[b].clear();
+          forbidden[a].insert(forbidden[b].begin(), forbidden[b].end());
+          cost[a] += cost[b];
+          if (!preferred[a].has_value() || intervals[b].incoming.has_value())
+            preferred[a] = preferred[b];
+
+          // the first related operand is enough
+          break;
+        }
+      }
+
+      // simplify: remove the nodes with less than K neighbors, when there's
+      // none left push the cheapest to spill and hope it still gets a color
+      std::vector<size_t> degree(total);
+      std::vector<bool> removed(total, true);
+      size_t remaining = 0;
+      for (size_t n = 0; n < total; ++n)
+      {
+        if (find(n) != n)
+          continue;
+
+        degree[n] = adjacent[n].size();
+        removed[n] = false;
+        remaining++;
+      }
+
+      std::vector<size_t> stack;
+      while (remaining > 0)
+      {
+        std::optional<size_t> pick;
+        for (size_t n = 0; n < total && !pick.has_value(); ++n)
+          if (!removed[n] && degree[n] < colors(n))
+            pick = n;
+
+        if (!pick.has_value())
+        {
+          double cheapest = INFINITY;
+          for (size_t n = 0; n < total; ++n)
+          {
+            if (removed[n])
+              continue;
+
+            double weight = cost[n] / std::max<size_t>(degree[n], 1);
+            if (weight < cheapest)
+            {
+              cheapest = weight;
+              pick = n;
+            }
+          }
+        }
+
+        removed[*pick] = true;
+        remaining--;
+        stack.push_back(*pick);
+        for (size_t n : adjacent[*pick])
+          if (!removed[n])
+            degree[n]--;
+      }
+
+      // select: give every node a color its neighbors don't have
+      std::unordered_map<size_t, Register::Knd> assigned;
+      while (!stack.empty())
+      {
+        size_t n = stack.back();
+        stack.pop_back();
+
+        auto free = [&](Register::Knd knd)
+        {
+          if (forbidden[n].contains(knd))
+            return false;
+
+          return std::none_of(adjacent[n].begin(), adjacent[n].end(), [&](size_t other) {
+            auto it = assigned.find(other);
+            return it != assigned.end() && it->second == knd;
+          });
+        };
+
+        if (preferred[n].has_value() && isFloat(*preferred[n]) == is_float(n) && free(*preferred[n]))
+        {
+          assigned[n] = *preferred[n];
+          continue;
+        }
+
+        if (is_float(n))
+        {
+          for (Register::Knd knd : float_registers)
+            if (free(knd)) { assigned[n] = knd; break; }
+        }
+        else
+        {
+          for (Register::Knd knd : integers)
+            if (free(knd)) { assigned[n] = knd; break; }
+        }
+      }
+
+      std::unordered_map<size_t, Storage> result;
+      for (size_t n = 0; n < total; ++n)
+      {
+        const Slot& slot = intervals[n].slot;
+        auto it = assigned.find(find(n));
+
+        if (it != assigned.end())
+        {
+          result[slot.getId()] = Register(slot.getType(), it->second);
+        }
+        // an actual spill, placed by `layout_frame()`
+        else
+        {
+          result[slot.getId()] = Memory(slot.getType(), 0);
+        }
+      }
+
+      return result;
+    }
+  }
+}
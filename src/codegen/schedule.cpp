@@ -0,0 +1,289 @@
+#include "codegen/schedule.h"
+#include "common.h"
+#include <algorithm>
+
+namespace soft {
+  namespace codegen {
+    using Opcode = MachineInstruction::Opcode;
+
+    // the cycles until the result is ready, and the cycles the divider
+    // stays busy for the instructions it runs (not pipelined)
+    struct Cost {
+      size_t latency;
+      size_t throughput;
+    };
+    struct Timings {
+      Cost alu;
+      Cost imul;
+      Cost idiv32;
+      Cost idiv64;
+      Cost fadd;
+      Cost fmul;
+      Cost fma;
+      Cost divss;
+      Cost divsd;
+      Cost convert;
+      // added when an operand is read from memory
+      size_t load;
+    };
+
+    // from the published instruction tables, the divisions are the
+    // usual case rather than the worst one
+    Timings timings(Cpu cpu)
+    {
+      switch (cpu)
+      {
+        case Cpu::Generic:
+          return { {1, 1}, {3, 1}, {26, 6}, {42, 24}, {4, 1}, {4, 1}, {4, 1}, {11, 3}, {14, 4}, {5, 1}, 5 };
+        case Cpu::Haswell:
+          return { {1, 1}, {3, 1}, {26, 9}, {39, 24}, {3, 1}, {5, 1}, {5, 1}, {13, 7}, {20, 14}, {4, 1}, 5 };
+        case Cpu::Skylake:
+          return { {1, 1}, {3, 1}, {26, 6}, {42, 24}, {4, 1}, {4, 1}, {4, 1}, {11, 3}, {14, 4}, {5, 1}, 5 };
+        case Cpu::Znver3:
+          return { {1, 1}, {3, 1}, {10, 6}, {17, 12}, {3, 1}, {3, 1}, {4, 1}, {10, 4}, {13, 5}, {4, 1}, 4 };
+      }
+      unreachable();
+    }
+
+    // the memory an instruction reads or writes
+    std::optional<Operand> memory_operand(const MachineInstruction& instruction)
+    {
+      if (instruction.getOpcode() == Opcode::Lea)
+        return std::nullopt;
+
+      for (const auto& operand : instruction.getOperands())
+        if (operand.isMemory() || (operand.isSymbol() && operand.getSymbol().isData()))
+          return operand;
+
+      return std::nullopt;
+    }
+    bool writes_memory(const MachineInstruction& instruction)
+    {
+      const auto& operands = instruction.getOperands();
+      return instruction.getOpcode() != Opcode::Lea && operands.size() >= 2 && (operands.back().isMemory() || operands.back().isSymbol());
+    }
+    Cost cost(const MachineInstruction& instruction, const Timings& timings)
+    {
+      const auto& operands = instruction.getOperands();
+      const bool float_op = !operands.empty() && !operands.back().isImmediate() && uses_xmm(operands.back().getType());
+      const bool wide = !operands.empty() && !operands.back().isImmediate() && operands.back().getType().getBitwidth() == 64;
+
+      Cost result = timings.alu;
+      switch (instruction.getOpcode())
+      {
+        case Opcode::Add: case Opcode::Sub:
+          if (float_op) result = timings.fadd;
+          break;
+        case Opcode::Mul:
+          result = float_op ? timings.fmul : timings.imul;
+          break;
+        case Opcode::Imul:
+          result = timings.imul;
+          break;
+        case Opcode::Fmadd: case Opcode::Fmsub: case Opcode::Fnmadd:
+          result = timings.fma;
+          break;
+        case Opcode::Div:
+          if (float_op)
+          {
+            const Type& type = operands.back().getType();
+            const Type& lane = type.isVector() ? type.getElement() : type;
+            result = lane.getBitwidth() == 32 ? timings.divss : timings.divsd;
+          }
+          else
+            result = wide ? timings.idiv64 : timings.idiv32;
+          break;
+        case Opcode::Idiv:
+          result = wide ? timings.idiv64 : timings.idiv32;
+          break;
+        case Opcode::Cvtsi2s: case Opcode::Cvtts2si: case Opcode::Cvts2s:
+          result = timings.convert;
+          break;
+        default:
+          break;
+      }
+
+      // everything but a store reads its memory operand first
+      bool store = instruction.getOpcode() == Opcode::Mov && writes_memory(instruction);
+      if (memory_operand(instruction).has_value() && !store)
+        result.latency += timings.load;
+
+      return result;
+    }
+
+    // returns false only when the two accesses can't overlap
+    bool may_alias(const Operand& a, const Operand& b)
+    {
+      if (a.isSymbol() && b.isSymbol())
+        return a.getSymbol().getName() == b.getSymbol().getName();
+
+      // the data never lives in the frame
+      if (a.isSymbol() || b.isSymbol())
+        return false;
+
+      // the globals never live in the frame either
+      const Memory& x = a.getMemory();
+      const Memory& y = b.getMemory();
+      if (x.getSymbol() != y.getSymbol())
+        return false;
+      if (x.getBase() != y.getBase() || x.getIndex().has_value() || y.getIndex().has_value())
+        return true;
+
+      off_t xend = x.getOffset() + (off_t) x.getType().getByteSize();
+      off_t yend = y.getOffset() + (off_t) y.getType().getByteSize();
+      return x.getOffset() < yend && y.getOffset() < xend;
+    }
+
+    // a dependence of an instruction on an earlier one
+    struct Edge {
+      size_t from;
+      size_t latency;
+    };
+
+    // schedules the instructions [begin, end) that have no barrier
+    void schedule_region(std::vector<MachineInstruction>& code, size_t begin, size_t end, const Timings& timings)
+    {
+      const size_t n = end - begin;
+      if (n < 2)
+        return;
+
+      std::vector<Cost> costs;
+      for (size_t i = begin; i < end; ++i)
+        costs.push_back(cost(code[i], timings));
+
+      // the registers are already allocated, so besides the true dependences
+      // an instruction can't move above a read or a write of its destination.
+      // NOTE: only a `jne` ending the region reads the flags, so they don't
+      // order anything but the last instruction setting them for it
+      std::vector<std::vector<Edge>> preds(n);
+      for (size_t j = 0; j < n; ++j)
+      {
+        const MachineInstruction& b = code[begin + j];
+        auto buses = b.getUses();
+        auto bdefs = b.getDefs();
+        auto bmem = memory_operand(b);
+
+        for (size_t i = 0; i < j; ++i)
+        {
+          const MachineInstruction& a = code[begin + i];
+          auto auses = a.getUses();
+          auto adefs = a.getDefs();
+
+          std::optional<size_t> latency;
+          auto depend = [&](size_t cycles) { latency = std::max(latency.value_or(0), cycles); };
+
+          for (Register::Knd knd : adefs)
+          {
+            if (std::find(buses.begin(), buses.end(), knd) != buses.end())
+              depend(costs[i].latency);
+            if (std::find(bdefs.begin(), bdefs.end(), knd) != bdefs.end())
+              depend(1);
+          }
+          for (Register::Knd knd : auses)
+            if (std::find(bdefs.begin(), bdefs.end(), knd) != bdefs.end())
+              depend(0);
+
+          // a load after a store waits for the forwarding
+          auto amem = memory_operand(a);
+          if (amem.has_value() && bmem.has_value() && (writes_memory(a) || writes_memory(b)) && may_alias(*amem, *bmem))
+            depend(writes_memory(a) ? timings.load : 0);
+
+          if (latency.has_value())
+            preds[j].push_back({ i, *latency });
+        }
+      }
+
+      if (end < code.size() && code[end].getOpcode() == Opcode::Jne)
+      {
+        std::vector<size_t> writers;
+        for (size_t j = 0; j < n; ++j)
+          if (code[begin + j].writesFlags())
+            writers.push_back(j);
+
+        for (size_t i = 0; i + 1 < writers.size(); ++i)
+          preds[writers.back()].push_back({ writers[i], 0 });
+      }
+
+      // the longest path to the end of the region goes first
+      std::vector<size_t> height(n);
+      for (size_t j = n; j-- > 0;)
+      {
+        height[j] = std::max(height[j], costs[j].latency);
+        for (const Edge& edge : preds[j])
+          height[edge.from] = std::max(height[edge.from], edge.latency + height[j]);
+      }
+
+      // one instruction a cycle, the divider runs one division at a time
+      std::vector<std::optional<size_t>> cycle(n);
+      std::vector<size_t> order;
+      size_t now = 0;
+      size_t divider = 0;
+      auto divides = [&](size_t i) { return costs[i].throughput > 1; };
+
+      while (order.size() < n)
+      {
+        std::optional<size_t> pick;
+        size_t earliest = SIZE_MAX;
+
+        for (size_t j = 0; j < n; ++j)
+        {
+          if (cycle[j].has_value())
+            continue;
+
+          size_t ready = 0;
+          bool scheduled = std::all_of(preds[j].begin(), preds[j].end(), [&](const Edge& edge) {
+            if (!cycle[edge.from].has_value())
+              return false;
+
+            ready = std::max(ready, *cycle[edge.from] + edge.latency);
+            return true;
+          });
+          if (!scheduled)
+            continue;
+
+          if (divides(j))
+            ready = std::max(ready, divider);
+
+          earliest = std::min(earliest, ready);
+          if (ready <= now && (!pick.has_value() || height[j] > height[*pick]))
+            pick = j;
+        }
+
+        // nothing can start yet, wait for the first one
+        if (!pick.has_value())
+        {
+          now = earliest;
+          continue;
+        }
+
+        cycle[*pick] = now;
+        if (divides(*pick))
+          divider = now + costs[*pick].throughput;
+
+        order.push_back(*pick);
+        now++;
+      }
+
+      std::vector<MachineInstruction> scheduled;
+      for (size_t j : order)
+        scheduled.push_back(std::move(code[begin + j]));
+      std::move(scheduled.begin(), scheduled.end(), code.begin() + begin);
+    }
+
+    void schedule(MachineFunction& fn, Cpu cpu)
+    {
+      const Timings table = timings(cpu);
+      auto& code = fn.getInstructions();
+
+      size_t begin = 0;
+      for (size_t i = 0; i <= code.size(); ++i)
+      {
+        if (i < code.size() && !code[i].isBarrier())
+          continue;
+
+        schedule_region(code, begin, i, table);
+        begin = i + 1;
+      }
+    }
+  }
+}
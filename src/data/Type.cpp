@@ -2,6 +2,11 @@
 namespace soft {
   Type::Type(Knd knd, size_t bitwidth, bool signd)
     : knd(knd), bitwidth(bitwidth), signd(signd) {}
+  Type::Type(Type element, size_t length)
+    : Type(Knd::Array, std::move(element), length) {}
+  Type::Type(Knd knd, Type element, size_t length)
+    : knd(knd), bitwidth(element.getBitwidth() * length), signd(element.isSigned()),
+      element(std::make_shared<const Type>(std::move(element))), length(length) {}
   Type::Type() = default;
 
   bool Type::isSigned() const { return this->signd; }
@@ -13,15 +18,29 @@ namespace soft {
   bool Type::isFloatingPoint() const { return this->knd == Knd::Float; }
   bool Type::isFloatingPoint(size_t bitwidth) const { return isFloatingPoint() && this->bitwidth == bitwidth; }
 
+  bool Type::isArray() const { return this->knd == Knd::Array; }
+  bool Type::isVector() const { return this->knd == Knd::Vector; }
+
   size_t Type::getBitwidth() const { return this->bitwidth; }
   Type::Knd Type::getKnd() const { return this->knd; }
   size_t Type::getByteSize() const { return this->bitwidth / 8; }
+  size_t Type::getAlignment() const { return this->element ? this->element->getAlignment() : getByteSize(); }
+  const Type& Type::getElement() const { return *this->element; }
+  size_t Type::getLength() const { return this->length; }
 
   void Type::setSigned(bool signd) { this->signd = signd; }
   void Type::setBitwidth(size_t bitwidth) { this->bitwidth = bitwidth; }
   void Type::setKnd(Knd knd) { this->knd = knd; }
+  void Type::setElement(Type element) { this->element = std::make_shared<const Type>(std::move(element)); }
+  void Type::setLength(size_t length) { this->length = length; }
+
+  bool Type::cmpTo(const Type& type) const
+  {
+    if ((isArray() && type.isArray()) || (isVector() && type.isVector()))
+      return this->length == type.getLength() && this->element->cmpTo(type.getElement());
 
-  bool Type::cmpTo(const Type& type) const { return cmpBitwidth(type.getBitwidth()) && cmpKnd(type.getKnd()); }
+    return cmpBitwidth(type.getBitwidth()) && cmpKnd(type.getKnd());
+  }
   bool Type::cmpBitwidth(const size_t bitwidth) const { return this->bitwidth == bitwidth; }
   bool Type::cmpKnd(const Knd knd) const { return this->knd == knd; }
 }
@@ -1,17 +1,22 @@
 #include "ir/Instruction.h"
+#include "common.h"
 
 namespace soft {
-  Alloca::Alloca(Type type, Slot dst)
-    : type(std::move(type)), dst(std::move(dst)) {}
+  Alloca::Alloca(Type type, Slot dst, std::optional<std::string> global)
+    : type(std::move(type)), dst(std::move(dst)), global(std::move(global)) {}
+
+  bool Alloca::isGlobal() const { return this->global.has_value(); }
 
   Type& Alloca::getType() { return this->type; }
   Slot& Alloca::getDst() { return this->dst; }
+  const std::string& Alloca::getGlobal() const { return *this->global; }
 
   const Type& Alloca::getType() const { return this->type; }
   const Slot& Alloca::getDst() const { return this->dst; }
 
   void Alloca::setType(Type type) { this->type = std::move(type); }
   void Alloca::setDst(Slot dst) { this->dst = std::move(dst); }
+  void Alloca::setGlobal(std::optional<std::string> global) { this->global = std::move(global); }
 
   Store::Store(Value src, Slot dst)
     : src(std::move(src)), dst(std::move(dst)) {}
@@ -69,4 +74,135 @@ namespace soft {
   void UnOp::setOperand(Value operand) { this->operand = std::move(operand); }
   void UnOp::setDst(Slot dst) { this->dst = std::move(dst); }
   void UnOp::setOp(Op op) { this->op = std::move(op); }
+
+  Call::Call(std::string name, std::vector<Value> args, Slot dst)
+    : name(std::move(name)), args(std::move(args)), dst(std::move(dst)) {}
+
+  std::string& Call::getName() { return this->name; }
+  std::vector<Value>& Call::getArgs() { return this->args; }
+  Slot& Call::getDst() { return this->dst; }
+
+  const std::string& Call::getName() const { return this->name; }
+  const std::vector<Value>& Call::getArgs() const { return this->args; }
+  const Slot& Call::getDst() const { return this->dst; }
+
+  void Call::setName(std::string name) { this->name = std::move(name); }
+  void Call::setArgs(std::vector<Value> args) { this->args = std::move(args); }
+  void Call::setDst(Slot dst) { this->dst = std::move(dst); }
+
+  LoadElement::LoadElement(Value array, Value index, Slot dst)
+    : array(std::move(array)), index(std::move(index)), dst(std::move(dst)) {}
+
+  Value& LoadElement::getArray() { return this->array; }
+  Value& LoadElement::getIndex() { return this->index; }
+  Slot& LoadElement::getDst() { return this->dst; }
+  size_t LoadElement::getStride() const { return this->stride; }
+  int64_t LoadElement::getOffset() const { return this->offset; }
+
+  const Value& LoadElement::getArray() const { return this->array; }
+  const Value& LoadElement::getIndex() const { return this->index; }
+  const Slot& LoadElement::getDst() const { return this->dst; }
+
+  void LoadElement::setArray(Value array) { this->array = std::move(array); }
+  void LoadElement::setIndex(Value index) { this->index = std::move(index); }
+  void LoadElement::setDst(Slot dst) { this->dst = std::move(dst); }
+  void LoadElement::setStride(size_t stride) { this->stride = stride; }
+  void LoadElement::setOffset(int64_t offset) { this->offset = offset; }
+
+  StoreElement::StoreElement(Value src, Value index, Slot dst)
+    : src(std::move(src)), index(std::move(index)), dst(std::move(dst)) {}
+
+  Value& StoreElement::getSrc() { return this->src; }
+  Value& StoreElement::getIndex() { return this->index; }
+  Slot& StoreElement::getDst() { return this->dst; }
+  size_t StoreElement::getStride() const { return this->stride; }
+  int64_t StoreElement::getOffset() const { return this->offset; }
+
+  const Value& StoreElement::getSrc() const { return this->src; }
+  const Value& StoreElement::getIndex() const { return this->index; }
+  const Slot& StoreElement::getDst() const { return this->dst; }
+
+  void StoreElement::setSrc(Value src) { this->src = std::move(src); }
+  void StoreElement::setIndex(Value index) { this->index = std::move(index); }
+  void StoreElement::setDst(Slot dst) { this->dst = std::move(dst); }
+  void StoreElement::setStride(size_t stride) { this->stride = stride; }
+  void StoreElement::setOffset(int64_t offset) { this->offset = offset; }
+
+  InitArray::InitArray(std::vector<Constant> elements, Slot dst)
+    : elements(std::move(elements)), dst(std::move(dst)) {}
+
+  std::vector<Constant>& InitArray::getElements() { return this->elements; }
+  Slot& InitArray::getDst() { return this->dst; }
+
+  const std::vector<Constant>& InitArray::getElements() const { return this->elements; }
+  const Slot& InitArray::getDst() const { return this->dst; }
+
+  void InitArray::setElements(std::vector<Constant> elements) { this->elements = std::move(elements); }
+  void InitArray::setDst(Slot dst) { this->dst = std::move(dst); }
+
+  Shuffle::Shuffle(Value src, std::vector<size_t> lanes, Slot dst)
+    : src(std::move(src)), lanes(std::move(lanes)), dst(std::move(dst)) {}
+
+  Value& Shuffle::getSrc() { return this->src; }
+  std::vector<size_t>& Shuffle::getLanes() { return this->lanes; }
+  Slot& Shuffle::getDst() { return this->dst; }
+
+  const Value& Shuffle::getSrc() const { return this->src; }
+  const std::vector<size_t>& Shuffle::getLanes() const { return this->lanes; }
+  const Slot& Shuffle::getDst() const { return this->dst; }
+
+  void Shuffle::setSrc(Value src) { this->src = std::move(src); }
+  void Shuffle::setLanes(std::vector<size_t> lanes) { this->lanes = std::move(lanes); }
+  void Shuffle::setDst(Slot dst) { this->dst = std::move(dst); }
+
+  Slot& getDestination(Instruction& instruction)
+  {
+    switch (instruction.index())
+    {
+      case 0:  return std::get<0>(instruction).getDst();
+      case 1:  return std::get<1>(instruction).getDst();
+      case 2:  return std::get<2>(instruction).getDst();
+      case 3:  return std::get<3>(instruction).getDst();
+      case 4:  return std::get<4>(instruction).getDst();
+      case 5:  return std::get<5>(instruction).getDst();
+      case 6:  return std::get<6>(instruction).getDst();
+      case 7:  return std::get<7>(instruction).getDst();
+      case 8:  return std::get<8>(instruction).getDst();
+      case 9:  return std::get<9>(instruction).getDst();
+      default: unreachable();
+    }
+  }
+  const Slot& getDestination(const Instruction& instruction)
+  {
+    return getDestination(const_cast<Instruction&>(instruction));
+  }
+
+  std::vector<Value*> getOperands(Instruction& instruction)
+  {
+    switch (instruction.index())
+    {
+      case 0:  return {};
+      case 1:  return { &std::get<1>(instruction).getSrc() };
+      case 2:  return { &std::get<2>(instruction).getSrc() };
+      case 3:  return { &std::get<3>(instruction).getLeft(), &std::get<3>(instruction).getRight() };
+      case 4:  return { &std::get<4>(instruction).getOperand() };
+      case 5:
+      {
+        std::vector<Value*> args;
+        for (Value& arg : std::get<5>(instruction).getArgs())
+          args.push_back(&arg);
+        return args;
+      }
+      case 6:  return { &std::get<6>(instruction).getArray(), &std::get<6>(instruction).getIndex() };
+      case 7:  return { &std::get<7>(instruction).getSrc(), &std::get<7>(instruction).getIndex() };
+      case 8:  return {};
+      case 9:  return { &std::get<9>(instruction).getSrc() };
+      default: unreachable();
+    }
+  }
+  std::vector<const Value*> getOperands(const Instruction& instruction)
+  {
+    std::vector<Value*> values = getOperands(const_cast<Instruction&>(instruction));
+    return { values.begin(), values.end() };
+  }
 }
@@ -45,21 +45,31 @@ namespace soft {
   void Function::addParam(Slot param) { this->params.push_back(std::move(param)); }
   void Function::addInstruction(Instruction instruction) { this->body.push_back(std::move(instruction)); }
 
-  Global::Global(std::string name, Type type, Constant init)
+  std::unordered_map<size_t, std::string> global_slots(const Function& fn)
+  {
+    std::unordered_map<size_t, std::string> result;
+    for (const auto& instruction : fn.getBody())
+      if (instruction.index() == 0 && std::get<0>(instruction).isGlobal()) // Alloca
+        result[std::get<0>(instruction).getDst().getId()] = std::get<0>(instruction).getGlobal();
+
+    return result;
+  }
+
+  Global::Global(std::string name, Type type, std::vector<Constant> init)
     : name(std::move(name)), type(std::move(type)), init(std::move(init)) {}
   Global::Global() = default;
 
   std::string& Global::getName() { return this->name; }
   Type& Global::getType() { return this->type; }
-  Constant& Global::getInit() { return this->init; }
+  std::vector<Constant>& Global::getInit() { return this->init; }
 
   const std::string& Global::getName() const { return this->name; }
   const Type& Global::getType() const { return this->type; }
-  const Constant& Global::getInit() const { return this->init; }
+  const std::vector<Constant>& Global::getInit() const { return this->init; }
 
   void Global::setName(std::string name) { this->name = std::move(name); }
   void Global::setType(Type type) { this->type = std::move(type); }
-  void Global::setInit(Constant init) { this->init = std::move(init); }
+  void Global::setInit(std::vector<Constant> init) { this->init = std::move(init); }
 
   Program::Program(std::string name)
     : name(std::move(name)) {}
@@ -1,10 +1,12 @@
 #include "ir/ir.h"
 #include "common.h"
+#include "opt/opt.h"
 
 namespace soft {
   namespace ir {
     std::unordered_map<std::string, Slot> symbol_table;
-    std::unordered_map<std::string, Function*> fns_table;
+    // the signature of every declared function
+    std::unordered_map<std::string, Function> fns_table;
     std::unordered_map<std::string, Global> globals;
     Function* current_function;
     Program program;
@@ -12,62 +14,22 @@ namespace soft {
 
     Value constant_folding(const Constant& a, BinOp::Op op, const Constant& b)
     {
-      auto constant_double_value = [](const Constant& c)
-      {
-        if (c.isIntegerValue()) return (double) c.getIntegerValue();
-        else if (c.isFloatValue()) return c.getFloatValue();
-        unreachable();
-      };
-      auto constant_int64_value = [](const Constant& c)
-      {
-        if (c.isFloatValue()) return (int64_t) c.getFloatValue();
-        else if (c.isIntegerValue()) return c.getIntegerValue();
-        unreachable();
-      };
-
-      auto calculate_double_constant = [](BinOp::Op op, double l, double r)
-      {
-        switch (op) {
-          case BinOp::Op::Add: return l + r;
-          case BinOp::Op::Sub: return l - r;
-          case BinOp::Op::Mul: return l * r;
-          case BinOp::Op::Div: return l / r;
-          default:             unreachable();
-        }
-      };
-      auto calculate_int64_constant = [](BinOp::Op op, int64_t l, int64_t r)
-      {
-        switch (op) {
-          case BinOp::Op::Add: return l + r;
-          case BinOp::Op::Sub: return l - r;
-          case BinOp::Op::Mul: return l * r;
-          case BinOp::Op::Div: return l / r;
-          default:             unreachable();
-        }
-      };
-
-      Constant result;
-      Type& type = result.getType();
+      Type type;
       type.setBitwidth(std::max(a.getType().getBitwidth(), b.getType().getBitwidth()));
 
       if (a.getType().isFloatingPoint() || b.getType().isFloatingPoint())
-      {
-        double av = constant_double_value(a);
-        double bv = constant_double_value(b);
-
         type.setKnd(Type::Knd::Float);
-        result.setValue(calculate_double_constant(op, av, bv));
-      }
       else
-      {
-        int64_t av = constant_int64_value(a);
-        int64_t bv = constant_int64_value(b);
-
         type.setKnd(Type::Knd::Integer);
-        result.setValue(calculate_int64_constant(op, av, bv));
+
+      std::optional<Constant> result = opt::fold(op, a, b, type);
+      if (!result.has_value())
+      {
+        std::println("Division by zero in a constant expression");
+        exit(1);
       }
 
-      return Value(result);
+      return Value(*result);
     }
     void constant_cast(Constant& c, const Type& type)
     {
@@ -94,6 +56,12 @@ namespace soft {
       if (value.getType().cmpTo(type))
         return;
 
+      if (value.getType().isVector() || type.isVector())
+      {
+        std::println("Vectors can't be converted to or from another type");
+        exit(1);
+      }
+
       if (value.isConstant())
         return constant_cast(value.getConstant(), type);
 
@@ -107,6 +75,171 @@ namespace soft {
       current_function->addInstruction( Store(src, dst) );
       return src;
     }
+    Constant zero(const Type& type)
+    {
+      if (type.isFloatingPoint())
+        return Constant(type, 0.0);
+
+      return Constant(type, (int64_t) 0);
+    }
+    // same as `generate_expr()` for the values that can't be an array
+    Value generate_scalar(const std::unique_ptr<ast::Expr>& expr)
+    {
+      Value value = generate_expr(expr);
+      if (value.getType().isArray())
+      {
+        std::println("Arrays can only be indexed");
+        exit(1);
+      }
+
+      return value;
+    }
+    // returns the array and the 64-bit index of `array[index]`
+    std::pair<Slot, Value> generate_index(const Value& array, const std::unique_ptr<ast::Expr>& index)
+    {
+      if (!array.getType().isArray())
+      {
+        std::println("Cannot index a value that is not an array");
+        exit(1);
+      }
+
+      Value position = generate_scalar(index);
+      if (!position.getType().isInteger())
+      {
+        std::println("Array index must be an integer");
+        exit(1);
+      }
+
+      // the constant ones are checked now, there's no
+      // runtime check for the others
+      const size_t length = array.getType().getLength();
+      if (position.isConstant())
+      {
+        int64_t value = position.getConstant().getIntegerValue();
+        if (value < 0 || (uint64_t) value >= length)
+        {
+          std::println("Index {} is out of bounds of an array of length {}", value, length);
+          exit(1);
+        }
+      }
+
+      cast(position, Type(Type::Knd::Integer, 64, position.getType().isSigned()));
+      return { array.getSlot(), position };
+    }
+    std::vector<Value> generate_elements(const std::unique_ptr<ast::ArrLit>& lit)
+    {
+      if (lit->elms.empty())
+      {
+        std::println("Empty arrays are not supported");
+        exit(1);
+      }
+
+      std::vector<Value> elements;
+      for (auto& elm : lit->elms)
+        elements.push_back(generate_scalar(elm));
+
+      return elements;
+    }
+    // the constant elements are written at once, the others one by one
+    void initialize_array(std::vector<Value> elements, const Slot& array)
+    {
+      const Type& type = array.getType();
+      if (elements.size() != type.getLength())
+      {
+        std::println("Array of length {} initialized with {} elements", type.getLength(), elements.size());
+        exit(1);
+      }
+
+      std::vector<Constant> constants;
+      std::vector<std::pair<size_t, Value>> others;
+      for (size_t i = 0; i < elements.size(); ++i)
+      {
+        cast(elements[i], type.getElement());
+        if (elements[i].isConstant())
+          constants.push_back(elements[i].getConstant());
+        else
+        {
+          constants.push_back(zero(type.getElement()));
+          others.push_back({ i, elements[i] });
+        }
+      }
+
+      if (others.size() < elements.size())
+        current_function->addInstruction( InitArray(std::move(constants), array) );
+
+      for (auto& [i, value] : others)
+      {
+        Constant position(Type(Type::Knd::Integer, 64), (int64_t) i);
+        current_function->addInstruction( StoreElement(value, position, array) );
+      }
+    }
+    // returns the lane of the vector `index` selects, it must be a constant
+    size_t generate_lane(const Type& vector, const std::unique_ptr<ast::Expr>& index)
+    {
+      Value lane = generate_scalar(index);
+      if (!lane.isConstant() || !lane.getType().isInteger())
+      {
+        std::println("The lanes of a vector are selected with an integer constant");
+        exit(1);
+      }
+
+      int64_t value = lane.getConstant().getIntegerValue();
+      if (value < 0 || (uint64_t) value >= vector.getLength())
+      {
+        std::println("Lane {} is out of bounds of a vector of {} lanes", value, vector.getLength());
+        exit(1);
+      }
+
+      return value;
+    }
+    // builds a vector from its lanes, they're written to a temporary
+    // array the whole vector is then loaded from
+    Value generate_vector(std::vector<Value> lanes, const Type& type)
+    {
+      if (lanes.size() != type.getLength())
+      {
+        std::println("Vector of {} lanes initialized with {} elements", type.getLength(), lanes.size());
+        exit(1);
+      }
+
+      Type array(type.getElement(), type.getLength());
+      Slot elements(array, id++);
+      current_function->addInstruction( Alloca(array, elements) );
+      initialize_array(std::move(lanes), elements);
+
+      Slot dst(type, id++);
+      current_function->addInstruction( LoadElement(elements, Constant(Type(Type::Knd::Integer, 64), (int64_t) 0), dst) );
+      return Value(dst);
+    }
+    // same as `generate_scalar()` for a value of the given type,
+    // an array literal builds the vector if it's one
+    Value generate_value(const std::unique_ptr<ast::Expr>& expr, const Type& type)
+    {
+      if (expr->index() == 4 && type.isVector()) // ArrLit
+        return generate_vector(generate_elements(std::get<4>(*expr)), type);
+
+      return generate_scalar(expr);
+    }
+    // `shuffle(v, l0, l1, ...)` reads the lane `l0` of the vector `v`
+    // first, then `l1`... one constant lane for each lane of `v`
+    Value generate_shuffle(const std::unique_ptr<ast::FnCall>& call)
+    {
+      Value vector = call->args.empty() ? Value() : generate_scalar(call->args.front());
+      const Type& type = vector.getType();
+      if (!type.isVector() || call->args.size() != type.getLength() + 1)
+      {
+        std::println("shuffle() takes a vector and the lane to read for each of its lanes");
+        exit(1);
+      }
+
+      std::vector<size_t> lanes;
+      for (size_t i = 1; i < call->args.size(); ++i)
+        lanes.push_back(generate_lane(type, call->args[i]));
+
+      Slot dst(type, id++);
+      current_function->addInstruction( Shuffle(vector, std::move(lanes), dst) );
+      return Value(dst);
+    }
     Value generate_expr(const std::unique_ptr<ast::Expr>& expr)
     {
       switch (expr->index())
@@ -122,9 +255,9 @@ namespace soft {
           // it will throw an overflow in parsing
           // therefore it is not possible here
           if (lit->v < (uint64_t) INT_MAX_VAL)
-            constant.getType().setBitwidth(4);
+            constant.getType().setBitwidth(32);
           else
-            constant.getType().setBitwidth(8);
+            constant.getType().setBitwidth(64);
 
           return Value(constant);
         }
@@ -139,9 +272,9 @@ namespace soft {
           // it will throw an overflow in parsing
           // therefore it is not possible here
           if (lit->v < (uint64_t) FLOAT_MAX_VAL)
-            constant.getType().setBitwidth(4);
+            constant.getType().setBitwidth(32);
           else
-            constant.getType().setBitwidth(8);
+            constant.getType().setBitwidth(64);
 
           return Value(constant);
         }
@@ -155,18 +288,29 @@ namespace soft {
         }
         case 4: // ArrLit
         {
-          todo();
+          std::println("Array literals can only initialize an array");
+          exit(1);
         }
         case 5: // Identifier
         {
           auto& ide = std::get<5>(*expr);
-          if (symbol_table.find(ide->name) == symbol_table.end())
+          if (symbol_table.find(ide->name) != symbol_table.end())
+            return Value(symbol_table[ide->name]);
+
+          if (globals.find(ide->name) == globals.end())
           {
             std::println("Use of undeclared identifier '{}'", ide->name);
             exit(1);
           }
 
-          return Value(symbol_table[ide->name]);
+          // the first use of a global in the function binds it
+          // to a slot, the later ones go through the same slot
+          const Global& global = globals[ide->name];
+          Slot slot = { global.getType(), id++ };
+          symbol_table[ide->name] = slot;
+
+          current_function->addInstruction( Alloca(global.getType(), slot, global.getName()) );
+          return Value(slot);
         }
         case 6: // VarDecl
         {
@@ -182,13 +326,33 @@ namespace soft {
             exit(1);
           }
 
+          // the type of an array literal is the one of its first element,
+          // unless it's a vector
+          if (dec->init && dec->init->index() == 4 && !(dec->type && dec->type->isVector())) // ArrLit
+          {
+            auto elements = generate_elements(std::get<4>(*dec->init));
+            Type type = dec->type ? *dec->type : Type(elements.front().getType(), elements.size());
+            if (!type.isArray())
+            {
+              std::println("Cannot initialize variable '{}' with an array literal", dec->name);
+              exit(1);
+            }
+
+            Slot slot = { type, id++ };
+            symbol_table[dec->name] = slot;
+
+            current_function->addInstruction( Alloca(type, slot) );
+            initialize_array(std::move(elements), slot);
+            return {};
+          }
+
           Type type;
           Value value;
           bool initialized = false;
 
           if (dec->init)
           {
-            value = generate_expr(dec->init);
+            value = dec->type ? generate_value(dec->init, *dec->type) : generate_scalar(dec->init);
             type = value.getType();
             initialized = true;
           }
@@ -198,6 +362,12 @@ namespace soft {
           if (dec->type)
             type = *dec->type;
 
+          if (initialized && type.isArray())
+          {
+            std::println("Array '{}' must be initialized with an array literal", dec->name);
+            exit(1);
+          }
+
           Slot slot = { type, id++ };
           symbol_table[dec->name] = slot;
 
@@ -210,13 +380,77 @@ namespace soft {
         }
         case 7: // FnCall
         {
-          todo();
+          auto& call = std::get<7>(*expr);
+          // the intrinsics, unless a function has the same name
+          if (call->name == "shuffle" && fns_table.find(call->name) == fns_table.end())
+            return generate_shuffle(call);
+
+          if (fns_table.find(call->name) == fns_table.end())
+          {
+            std::println("Call to undeclared function '{}'", call->name);
+            exit(1);
+          }
+
+          const Function& callee = fns_table[call->name];
+          const auto& params = callee.getParams();
+          if (call->args.size() != params.size())
+          {
+            std::println("Function '{}' takes {} arguments but {} were given", call->name, params.size(), call->args.size());
+            exit(1);
+          }
+
+          std::vector<Value> args;
+          for (size_t i = 0; i < params.size(); ++i)
+          {
+            Value arg = generate_value(call->args[i], params[i].getType());
+            cast(arg, params[i].getType());
+            args.push_back(arg);
+          }
+
+          Slot dst(callee.getType(), id++);
+          current_function->addInstruction( Call(call->name, std::move(args), dst) );
+          return Value(dst);
         }
         case 8: // AssgnOp
         {
           auto& assgn = std::get<8>(*expr);
-          Value src = generate_expr(assgn->val);
-          Value dst = generate_expr(assgn->var);
+          if (assgn->var->index() == 11) // Index
+          {
+            auto& index = std::get<11>(*assgn->var);
+            Value src = generate_scalar(assgn->val);
+            Value base = generate_expr(index->array);
+            if (base.getType().isVector())
+            {
+              std::println("The lanes of a vector can't be assigned, build a new vector instead");
+              exit(1);
+            }
+
+            auto [array, position] = generate_index(base, index->index);
+
+            cast(src, array.getType().getElement());
+            current_function->addInstruction( StoreElement(src, position, array) );
+            return src;
+          }
+
+          if (assgn->val->index() == 4) // ArrLit
+          {
+            auto elements = generate_elements(std::get<4>(*assgn->val));
+            Value dst = generate_expr(assgn->var);
+            if (dst.isSlot() && dst.getType().isVector())
+              return assign(generate_vector(std::move(elements), dst.getType()), dst.getSlot());
+
+            if (!dst.isSlot() || !dst.getType().isArray())
+            {
+              std::println("Cannot assign an array literal to a non-array");
+              exit(1);
+            }
+
+            initialize_array(std::move(elements), dst.getSlot());
+            return {};
+          }
+
+          Value src = generate_scalar(assgn->val);
+          Value dst = generate_scalar(assgn->var);
 
           if (!dst.isSlot()) // not a Register
           {
@@ -229,8 +463,8 @@ namespace soft {
         case 9: // BinOp
         {
           auto& operation = std::get<9>(*expr);
-          Value lhs = generate_expr(operation->lhs);
-          Value rhs = generate_expr(operation->rhs);
+          Value lhs = generate_scalar(operation->lhs);
+          Value rhs = generate_scalar(operation->rhs);
 
           BinOp::Op op;
           switch (operation->op)
@@ -239,8 +473,35 @@ namespace soft {
             case Token::Knd::Minus: op = BinOp::Op::Sub; break;
             case Token::Knd::Mul:   op = BinOp::Op::Mul; break;
             case Token::Knd::Div:   op = BinOp::Op::Div; break;
+            case Token::Knd::Mod:   op = BinOp::Op::Mod; break;
             default:                unreachable();
           }
+
+          // the vectors operate lane by lane, the lanes are never converted
+          if (lhs.getType().isVector() || rhs.getType().isVector())
+          {
+            const Type& type = lhs.getType();
+            if (!type.cmpTo(rhs.getType()))
+            {
+              std::println("The operands of a vector operation must be vectors of the same type");
+              exit(1);
+            }
+            if (op == BinOp::Op::Mod || (op == BinOp::Op::Div && type.getElement().isInteger()))
+            {
+              std::println("{} of integer vectors is not supported", op == BinOp::Op::Mod ? "Modulo" : "Division");
+              exit(1);
+            }
+
+            Slot dst(type, id++);
+            current_function->addInstruction( BinOp(lhs, rhs, op, dst) );
+            return Value(dst);
+          }
+
+          if (op == BinOp::Op::Mod && (lhs.getType().isFloatingPoint() || rhs.getType().isFloatingPoint()))
+          {
+            std::println("Modulo of floating point values is not supported");
+            exit(1);
+          }
           
           if (lhs.isConstant() && rhs.isConstant())
             return constant_folding(lhs.getConstant(), op, rhs.getConstant());
@@ -257,6 +518,11 @@ namespace soft {
           else
             dst.getType().setKnd(Type::Knd::Integer);
 
+          // unsigned operands make the whole operation unsigned,
+          // literals are always signed so they don't decide anything
+          bool signd = (lhs.isConstant() || lt.isSigned()) && (rhs.isConstant() || rt.isSigned());
+          dst.getType().setSigned(signd || dst.getType().isFloatingPoint());
+
           cast(lhs, dst.getType());
           cast(rhs, dst.getType());
 
@@ -266,7 +532,7 @@ namespace soft {
         case 10: // UnOp
         {
           auto& operation = std::get<10>(*expr);
-          Value operand = generate_expr(operation->oprand);
+          Value operand = generate_scalar(operation->oprand);
 
           UnOp::Op op;
           switch (operation->op) {
@@ -279,6 +545,25 @@ namespace soft {
           current_function->addInstruction( UnOp(operand, dst, op) );
           return Value(dst);
         }
+        case 11: // Index
+        {
+          auto& index = std::get<11>(*expr);
+          Value base = generate_expr(index->array);
+
+          // a lane of a vector
+          if (base.getType().isVector())
+          {
+            Slot dst(base.getType().getElement(), id++);
+            current_function->addInstruction( Shuffle(base, { generate_lane(base.getType(), index->index) }, dst) );
+            return Value(dst);
+          }
+
+          auto [array, position] = generate_index(base, index->index);
+
+          Slot dst(array.getType().getElement(), id++);
+          current_function->addInstruction( LoadElement(array, position, dst) );
+          return Value(dst);
+        }
       }
 
       unreachable();
@@ -302,7 +587,7 @@ namespace soft {
       if (current_function->isTerminated())
         return; // don't do anything
 
-      Value value = generate_expr(stmt->expr);
+      Value value = generate_value(stmt->expr, current_function->getType());
 
       // the return value type does not equal to the return type of the function
       if (!value.getType().cmpTo(current_function->getType()))
@@ -312,6 +597,12 @@ namespace soft {
     }
     void generate_fn_dec(const std::unique_ptr<ast::FnDecl>& stmt)
     {
+      if (stmt->type->isArray())
+      {
+        std::println("Arrays can't be returned from functions");
+        exit(1);
+      }
+
       Function fn(stmt->name, *stmt->type, false);
       symbol_table.clear();
       id = 0;
@@ -328,17 +619,28 @@ namespace soft {
           std::println("parameter type must be specified");
           exit(1);
         }
+        if (param->type->isArray())
+        {
+          std::println("Arrays can't be passed to functions");
+          exit(1);
+        }
 
         Slot slot = { *param->type, id++ };
         fn.addParam(slot);
         symbol_table[param->name] = slot;
       }
 
+      fns_table[fn.getName()] = fn;
       program.addFunction(fn);
-      fns_table[fn.getName()] = &program.getFunctions().back();
     }
     void generate_fn_def(const std::unique_ptr<ast::FnDef>& stmt)
     {
+      if (stmt->dec->type->isArray())
+      {
+        std::println("Arrays can't be returned from functions");
+        exit(1);
+      }
+
       Function fn(stmt->dec->name, *stmt->dec->type, true);
 
       symbol_table.clear();
@@ -355,12 +657,19 @@ namespace soft {
           std::println("parameter type must be specified");
           exit(1);
         }
+        if (param->type->isArray())
+        {
+          std::println("Arrays can't be passed to functions");
+          exit(1);
+        }
 
         Slot slot = { *param->type, id++ };
         fn.addParam(slot);
         symbol_table[param->name] = slot;
       }
 
+      // declared before the body so it can call itself
+      fns_table[fn.getName()] = fn;
       current_function = &fn;
 
       for (auto& stmt : stmt->body)
@@ -368,14 +677,115 @@ namespace soft {
 
       fn.setTotalRegisters(id);
       program.addFunction(fn);
-      fns_table[fn.getName()] = &program.getFunctions().back();
+      current_function = nullptr;
+    }
+    void generate_global(const std::unique_ptr<ast::Expr>& expr)
+    {
+      if (expr->index() != 6) // VarDecl
+      {
+        std::println("Only declarations are allowed outside of a function");
+        exit(1);
+      }
+
+      auto& dec = std::get<6>(*expr);
+      if (globals.find(dec->name) != globals.end() || fns_table.find(dec->name) != fns_table.end())
+      {
+        std::println("Redefinition of symbol '{}'", dec->name);
+        exit(1);
+      }
+      if (!dec->type && !dec->init)
+      {
+        std::println("Either an initializer or a type is required in the declaration of variablle '{}'", dec->name);
+        exit(1);
+      }
+
+      // the initializer is generated in a scratch function,
+      // anything that needs an instruction is not a constant
+      auto constant = [&](const std::unique_ptr<ast::Expr>& init)
+      {
+        Function scratch;
+        current_function = &scratch;
+        symbol_table.clear();
+        Value value = generate_scalar(init);
+        current_function = nullptr;
+
+        if (!value.isConstant() || !scratch.getBody().empty())
+        {
+          std::println("The initializer of global '{}' is not a constant", dec->name);
+          exit(1);
+        }
+
+        return value.getConstant();
+      };
+
+      Type type;
+      std::vector<Constant> init;
+
+      if (dec->init && dec->init->index() == 4) // ArrLit
+      {
+        auto& lit = std::get<4>(*dec->init);
+        for (auto& elm : lit->elms)
+          init.push_back(constant(elm));
+
+        if (init.empty())
+        {
+          std::println("Empty arrays are not supported");
+          exit(1);
+        }
+
+        type = Type(init.front().getType(), init.size());
+      }
+      else if (dec->init)
+      {
+        init.push_back(constant(dec->init));
+        type = init.front().getType();
+      }
+
+      // Priority goes to the specified type
+      if (dec->type)
+        type = *dec->type;
+
+      // the vectors are initialized like the arrays, one lane after the other
+      const bool aggregate = type.isArray() || type.isVector();
+      const size_t length = aggregate ? type.getLength() : 1;
+      const Type element = aggregate ? type.getElement() : type;
+
+      if (!dec->init && element.isVector())
+        init.assign(length * element.getLength(), zero(element.getElement()));
+      else if (!dec->init)
+        init.assign(length, zero(element));
+      else if (aggregate != (dec->init->index() == 4))
+      {
+        std::println("Global '{}' must be initialized with {}", dec->name, aggregate ? "an array literal" : "a scalar");
+        exit(1);
+      }
+      else if (init.size() != length)
+      {
+        std::println("{} of length {} initialized with {} elements", type.isVector() ? "Vector" : "Array", length, init.size());
+        exit(1);
+      }
+
+      const Type scalar = element.isVector() ? element.getElement() : element;
+      for (auto& value : init)
+        value = opt::fold_cast(value, scalar);
+
+      Global global(dec->name, type, init);
+      globals[dec->name] = global;
+      program.addGlobal(global);
     }
     void generate_stmt(const std::unique_ptr<ast::Stmt>& stmt)
     {
       switch (stmt->index())
       {
         case 0:  generate_return(std::get<0>(*stmt));     break;
-        case 1:  generate_expr(std::get<1>(*stmt)->expr); break;
+        case 1:
+        {
+          if (current_function)
+            generate_expr(std::get<1>(*stmt)->expr);
+          else
+            generate_global(std::get<1>(*stmt)->expr);
+          break;
+        }
         case 2:  generate_fn_dec(std::get<2>(*stmt));      break;
         case 3:  generate_fn_def(std::get<3>(*stmt));      break;
         default: unreachable();
@@ -83,7 +83,13 @@ namespace soft {
 
       // floating points
       "f32",
-      "f64"
+      "f64",
+
+      // vectors, the lane type then the number of lanes
+      "f32x4",
+      "f64x2",
+      "i32x4",
+      "f32x8"
     };
 
     bool digit(char c) 
@@ -4,6 +4,7 @@
 #include "lexer.h"
 #include "parser.h"
 #include "ir/ir.h"
+#include "opt/opt.h"
 #include "codegen/codegen.h"
 
 using namespace soft;
@@ -21,7 +22,11 @@ int main(int argc, char *argv[])
   auto ast = ast::generate(tkns);
   Program program = ir::generate(ast, opts.program);
 
-  std::string code = codegen::generate(program);
+  opt::Stats stats = opt::optimize(program, opts);
+  if (opts.stats)
+    opt::print_stats(stats);
+
+  std::string code = codegen::generate(program, opts);
   std::print("{}", code);
   return 0;
 }
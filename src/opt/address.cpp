@@ -0,0 +1,142 @@
+#include "opt/opt.h"
+#include <unordered_set>
+
+namespace soft {
+  namespace opt {
+    // the index `base * stride + offset`
+    struct Address {
+      Value base;
+      int64_t stride;
+      int64_t offset;
+    };
+
+    // returns true if x86 can address the element `index * stride + offset`
+    // of an array of `size`-byte elements without computing it first
+    bool addressable(const Address& address, size_t size)
+    {
+      const int64_t scale = address.stride * (int64_t) size;
+      if (address.stride != 1 && scale != 1 && scale != 2 && scale != 4 && scale != 8)
+        return false;
+
+      // the displacement is 32-bit and the frame offset is added to it
+      return address.offset >= -(1 << 24) && address.offset <= (1 << 24);
+    }
+
+    size_t fold_addresses(Function& fn)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      auto& body = fn.getBody();
+
+      // the variables may be stored to between the arithmetic and the
+      // access, only the temporaries and the parameters never stored
+      // to still hold the value the index was computed from
+      std::unordered_set<size_t> variables;
+      for (const auto& instruction : body)
+        if (instruction.index() == 0 || instruction.index() == 1) // Alloca, Store
+          variables.insert(getDestination(instruction).getId());
+
+      // slot id -> the position of its `Convert` or `BinOp`
+      std::unordered_map<size_t, size_t> defs;
+      for (size_t i = 0; i < body.size(); ++i)
+        if (body[i].index() == 2 || body[i].index() == 3)
+          defs[getDestination(body[i]).getId()] = i;
+
+      // the 64-bit arithmetic of an index with a constant, the address
+      // wraps around the same way the operation does
+      auto decompose = [&](const Value& value) -> std::optional<Address>
+      {
+        if (!value.isSlot() || !defs.contains(value.getSlot().getId()))
+          return std::nullopt;
+
+        const auto& instruction = body[defs[value.getSlot().getId()]];
+        auto wide = [](const Value& operand) { return operand.getType().isInteger() && operand.getType().getBitwidth() == 64; };
+
+        // the signedness doesn't change the address
+        if (instruction.index() == 2) // Convert
+        {
+          const Value& src = std::get<2>(instruction).getSrc();
+          if (!wide(src) || !wide(value))
+            return std::nullopt;
+          return Address { src, 1, 0 };
+        }
+
+        const auto& binop = std::get<3>(instruction);
+        const Value& left = binop.getLeft();
+        const Value& right = binop.getRight();
+        if (!wide(value) || !wide(left) || !wide(right) || (left.isConstant() == right.isConstant()))
+          return std::nullopt;
+
+        const Value& operand = left.isConstant() ? right : left;
+        const int64_t k = (left.isConstant() ? left : right).getConstant().getIntegerValue();
+        switch (binop.getOp())
+        {
+          case BinOp::Op::Add:
+            return Address { operand, 1, k };
+          case BinOp::Op::Sub:
+            if (left.isConstant() || k == INT64_MIN)
+              return std::nullopt;
+            return Address { operand, 1, -k };
+          case BinOp::Op::Mul:
+            if (k < 1 || k > 8)
+              return std::nullopt;
+            return Address { operand, k, 0 };
+          default:
+            return std::nullopt;
+        }
+      };
+
+      size_t folded = 0;
+      auto fold = [&](auto& access, const Type& array)
+      {
+        if (!access.getIndex().isSlot())
+          return;
+
+        Address address { access.getIndex(), (int64_t) access.getStride(), access.getOffset() };
+        while (auto inner = decompose(address.base))
+        {
+          if (!inner->base.isSlot() || variables.contains(inner->base.getSlot().getId()))
+            break;
+
+          // (base * s + o) * stride + offset
+          Address combined {
+            inner->base,
+            inner->stride * address.stride,
+            address.offset + inner->offset * address.stride,
+          };
+          if (std::abs(inner->offset) > (1 << 24) || !addressable(combined, array.getElement().getByteSize()))
+            break;
+
+          address = combined;
+        }
+
+        if (address.base.getSlot().getId() == access.getIndex().getSlot().getId())
+          return;
+
+        access.setIndex(address.base);
+        access.setStride(address.stride);
+        access.setOffset(address.offset);
+        folded++;
+      };
+
+      for (auto& instruction : body)
+      {
+        if (instruction.index() == 6) // LoadElement
+        {
+          auto& load = std::get<6>(instruction);
+          fold(load, load.getArray().getType());
+        }
+        else if (instruction.index() == 7) // StoreElement
+        {
+          auto& store = std::get<7>(instruction);
+          fold(store, store.getDst().getType());
+        }
+      }
+
+      // the arithmetic that only computed the indices is dead now,
+      // `dead_code_elimination` removes it
+      return folded;
+    }
+  }
+}
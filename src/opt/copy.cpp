@@ -0,0 +1,179 @@
+#include "opt/opt.h"
+#include <unordered_set>
+
+namespace soft {
+  namespace opt {
+    bool same_type(const Type& a, const Type& b)
+    {
+      return a.cmpTo(b) && a.isSigned() == b.isSigned();
+    }
+    // returns true if converting from `from` to `to` keeps
+    // the exact value of every possible source
+    bool preserves_value(const Type& from, const Type& to)
+    {
+      if (from.isInteger() && to.isInteger())
+      {
+        // i8 -> u16 would turn -1 into 65535
+        return to.getBitwidth() > from.getBitwidth() && (to.isSigned() || !from.isSigned());
+      }
+
+      if (from.isInteger() && to.isFloatingPoint())
+      {
+        size_t mantissa = to.getBitwidth() == 32 ? 24 : 53;
+        return from.getBitwidth() <= mantissa;
+      }
+
+      if (from.isFloatingPoint() && to.isFloatingPoint())
+        return to.getBitwidth() >= from.getBitwidth();
+
+      return false;
+    }
+    // returns true if `convert(convert(x, middle), to)` can be
+    // computed as `convert(x, to)`
+    bool collapsible(const Type& from, const Type& middle, const Type& to)
+    {
+      if (preserves_value(from, middle))
+        return true;
+
+      // truncating twice is truncating once
+      return from.isInteger() && middle.isInteger() && to.isInteger() &&
+        middle.getBitwidth() < from.getBitwidth() &&
+        to.getBitwidth() <= middle.getBitwidth();
+    }
+
+    size_t copy_propagation(Function& fn)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      // the source of every `Convert` and how many times it was
+      // stored to when it was read, temporaries are never stored to
+      struct Conversion { Slot src; size_t version; };
+      std::unordered_map<size_t, Conversion> conversions;
+      std::unordered_map<size_t, size_t> versions;
+
+      // variables that currently hold the same value as another slot
+      std::unordered_map<size_t, Slot> copies;
+      // slots of the removed instructions and what replaces them
+      std::unordered_map<size_t, Slot> replaced;
+      size_t propagated = 0;
+
+      // variables may be stored to after the removed instruction, so
+      // only temporaries can replace it
+      std::unordered_set<size_t> variables;
+      for (const auto& param : fn.getParams())
+        variables.insert(param.getId());
+      for (const auto& instruction : fn.getBody())
+        if (instruction.index() == 0) // Alloca
+          variables.insert(getDestination(instruction).getId());
+      const auto globals = global_slots(fn);
+
+      auto rewrite = [&](Value& value)
+      {
+        if (!value.isSlot())
+          return;
+
+        const size_t id = value.getSlot().getId();
+        if (auto it = replaced.find(id); it != replaced.end())
+          value.setValue(it->second);
+        else if (auto it = copies.find(id); it != copies.end())
+        {
+          value.setValue(it->second);
+          propagated++;
+        }
+      };
+      // forgets the copies that involve the variable
+      auto kill = [&](size_t id)
+      {
+        copies.erase(id);
+        std::erase_if(copies, [&](const auto& copy) { return copy.second.getId() == id; });
+      };
+
+      auto& body = fn.getBody();
+      std::vector<Instruction> result;
+      result.reserve(body.size());
+
+      for (auto& instruction : body)
+      {
+        for (Value* value : getOperands(instruction))
+          rewrite(*value);
+
+        switch (instruction.index())
+        {
+          case 1: // Store
+          {
+            auto& store = std::get<1>(instruction);
+            const Slot& dst = store.getDst();
+            const Value& src = store.getSrc();
+
+            kill(dst.getId());
+            versions[dst.getId()]++;
+
+            if (src.isSlot() && src.getSlot().getId() != dst.getId() &&
+                same_type(src.getSlot().getType(), dst.getType()))
+              copies.emplace(dst.getId(), src.getSlot());
+            break;
+          }
+          case 2: // Convert
+          {
+            auto& convert = std::get<2>(instruction);
+            const Slot& dst = convert.getDst();
+            if (!convert.getSrc().isSlot())
+              break;
+
+            // convert(convert(x)) -> convert(x)
+            auto it = conversions.find(convert.getSrc().getSlot().getId());
+            if (it != conversions.end() && versions[it->second.src.getId()] == it->second.version)
+            {
+              const Slot origin = it->second.src;
+              const Type& from = origin.getType();
+
+              if (collapsible(from, convert.getSrc().getType(), dst.getType()))
+              {
+                // back to the original type
+                if (same_type(from, dst.getType()))
+                {
+                  if (!variables.contains(origin.getId()))
+                  {
+                    replaced[dst.getId()] = origin;
+                    propagated++;
+                    continue;
+                  }
+                }
+                else if (!from.cmpTo(dst.getType()))
+                {
+                  convert.setSrc(origin);
+                  propagated++;
+                }
+              }
+            }
+
+            const Slot& src = convert.getSrc().getSlot();
+            conversions[dst.getId()] = { src, versions[src.getId()] };
+            break;
+          }
+          // the callee may store to the globals
+          case 5: // Call
+          {
+            for (const auto& [id, name] : globals)
+            {
+              kill(id);
+              versions[id]++;
+            }
+            break;
+          }
+          default:
+            break;
+        }
+
+        result.push_back(std::move(instruction));
+      }
+
+      if (fn.isTerminated())
+        rewrite(fn.getTerminator().getValue());
+
+      fn.setBody(std::move(result));
+      return propagated;
+    }
+  }
+}
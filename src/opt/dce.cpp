@@ -0,0 +1,89 @@
+#include "opt/opt.h"
+#include <unordered_set>
+
+namespace soft {
+  namespace opt {
+    size_t dead_code_elimination(Function& fn)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      auto& body = fn.getBody();
+      std::vector<bool> dead(body.size(), false);
+
+      // the slots that will be read by a later instruction
+      std::unordered_set<size_t> live;
+      if (fn.isTerminated() && fn.getTerminator().getValue().isSlot())
+        live.insert(fn.getTerminator().getValue().getSlot().getId());
+
+      // the globals are read after the function returns and by
+      // every callee, only an overwritten store to them is dead
+      const auto globals = global_slots(fn);
+      for (const auto& [id, name] : globals)
+        live.insert(id);
+
+      // walk backward: an instruction is dead if nothing after
+      // it reads the slot it writes before the slot gets written again
+      for (size_t i = body.size(); i-- > 0;)
+      {
+        Instruction& instruction = body[i];
+
+        // allocas are handled after we know which variables survived
+        if (instruction.index() == 0)
+          continue;
+
+        // calls may have side effects, they stay even if
+        // the result is never read
+        size_t dst = getDestination(instruction).getId();
+        if (live.find(dst) == live.end() && instruction.index() != 5)
+        {
+          dead[i] = true;
+          continue;
+        }
+
+        // the value is (re)defined here, so anything
+        // before this point can't be read through it,
+        // unless only one element of an array is written
+        if (instruction.index() != 7) // StoreElement
+          live.erase(dst);
+
+        for (const Value* value : getOperands(instruction))
+          if (value->isSlot())
+            live.insert(value->getSlot().getId());
+
+        if (instruction.index() == 5) // Call
+          for (const auto& [id, name] : globals)
+            live.insert(id);
+      }
+
+      // a variable is still needed if any surviving instruction touches it
+      std::unordered_set<size_t> referenced;
+      for (size_t i = 0; i < body.size(); ++i)
+      {
+        if (dead[i] || body[i].index() == 0)
+          continue;
+
+        referenced.insert(getDestination(body[i]).getId());
+        for (const Value* value : getOperands(body[i]))
+          if (value->isSlot())
+            referenced.insert(value->getSlot().getId());
+      }
+      if (fn.isTerminated() && fn.getTerminator().getValue().isSlot())
+        referenced.insert(fn.getTerminator().getValue().getSlot().getId());
+
+      for (size_t i = 0; i < body.size(); ++i)
+        if (body[i].index() == 0 && referenced.find(getDestination(body[i]).getId()) == referenced.end())
+          dead[i] = true;
+
+      std::vector<Instruction> result;
+      result.reserve(body.size());
+      for (size_t i = 0; i < body.size(); ++i)
+        if (!dead[i])
+          result.push_back(std::move(body[i]));
+
+      size_t removed = body.size() - result.size();
+      fn.setBody(std::move(result));
+      return removed;
+    }
+  }
+}
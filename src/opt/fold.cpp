@@ -0,0 +1,154 @@
+#include "opt/opt.h"
+#include "common.h"
+
+namespace soft {
+  namespace opt {
+    int64_t wrap(uint64_t value, const Type& type)
+    {
+      size_t bitwidth = type.getBitwidth();
+      if (bitwidth >= 64)
+        return (int64_t) value;
+
+      uint64_t mask = (1ULL << bitwidth) - 1;
+      value &= mask;
+
+      // sign extend
+      if (type.isSigned() && (value >> (bitwidth - 1)) & 1)
+        value |= ~mask;
+
+      return (int64_t) value;
+    }
+    double round_to(double value, const Type& type)
+    {
+      if (type.getBitwidth() == 32)
+        return (double) (float) value;
+
+      return value;
+    }
+
+    Constant fold_cast(const Constant& constant, const Type& type)
+    {
+      const Type& from = constant.getType();
+      Constant result;
+      result.setType(type);
+
+      if (type.isInteger())
+      {
+        if (constant.isIntegerValue())
+          result.setValue(wrap(constant.getIntegerValue(), type));
+        else if (type.isSigned())
+          result.setValue(wrap((int64_t) constant.getFloatValue(), type));
+        else
+          result.setValue(wrap((uint64_t) constant.getFloatValue(), type));
+      }
+      else // if (type.isFloatingPoint())
+      {
+        if (constant.isFloatValue())
+          result.setValue(round_to(constant.getFloatValue(), type));
+        else if (from.isSigned())
+          result.setValue(round_to((double) constant.getIntegerValue(), type));
+        else
+          result.setValue(round_to((double) (uint64_t) constant.getIntegerValue(), type));
+      }
+
+      return result;
+    }
+    std::optional<Constant> fold(BinOp::Op op, const Constant& lhs, const Constant& rhs, const Type& type)
+    {
+      Constant l = fold_cast(lhs, type);
+      Constant r = fold_cast(rhs, type);
+      Constant result;
+      result.setType(type);
+
+      if (type.isFloatingPoint())
+      {
+        double lv = l.getFloatValue();
+        double rv = r.getFloatValue();
+
+        switch (op)
+        {
+          case BinOp::Op::Add: result.setValue(round_to(lv + rv, type)); break;
+          case BinOp::Op::Sub: result.setValue(round_to(lv - rv, type)); break;
+          case BinOp::Op::Mul: result.setValue(round_to(lv * rv, type)); break;
+          case BinOp::Op::Div: result.setValue(round_to(lv / rv, type)); break;
+          default:             unreachable();
+        }
+
+        return result;
+      }
+
+      // do the arithmetic on unsigned values so overflow wraps
+      // instead of being undefined behaviour
+      uint64_t lv = l.getIntegerValue();
+      uint64_t rv = r.getIntegerValue();
+
+      switch (op)
+      {
+        case BinOp::Op::Add: result.setValue(wrap(lv + rv, type)); break;
+        case BinOp::Op::Sub: result.setValue(wrap(lv - rv, type)); break;
+        case BinOp::Op::Mul: result.setValue(wrap(lv * rv, type)); break;
+        case BinOp::Op::Div:
+        {
+          // leave it to the runtime
+          if (rv == 0)
+            return std::nullopt;
+
+          if (!type.isSigned())
+            result.setValue(wrap(lv / rv, type));
+          // INT_MIN / -1 overflows, it wraps to INT_MIN
+          else if ((int64_t) rv == -1)
+            result.setValue(wrap(-lv, type));
+          else
+            result.setValue(wrap((int64_t) lv / (int64_t) rv, type));
+          break;
+        }
+        case BinOp::Op::Mod:
+        {
+          if (rv == 0)
+            return std::nullopt;
+
+          if (!type.isSigned())
+            result.setValue(wrap(lv % rv, type));
+          else if ((int64_t) rv == -1)
+            result.setValue((int64_t) 0);
+          else
+            result.setValue(wrap((int64_t) lv % (int64_t) rv, type));
+          break;
+        }
+        default: unreachable();
+      }
+
+      return result;
+    }
+    std::optional<Constant> fold(UnOp::Op op, const Constant& operand, const Type& type)
+    {
+      Constant value = fold_cast(operand, type);
+      Constant result;
+      result.setType(type);
+
+      switch (op)
+      {
+        case UnOp::Op::Neg:
+        {
+          if (type.isFloatingPoint())
+            result.setValue(-value.getFloatValue());
+          else
+            result.setValue(wrap(-(uint64_t) value.getIntegerValue(), type));
+          break;
+        }
+        case UnOp::Op::Not:
+        {
+          // logical not
+          if (type.isFloatingPoint())
+            return std::nullopt;
+
+          result.setValue((int64_t) (value.getIntegerValue() == 0));
+          break;
+        }
+        default: unreachable();
+      }
+
+      return result;
+    }
+  }
+}
@@ -0,0 +1,175 @@
+#include "opt/opt.h"
+#include "common.h"
+#include <bit>
+
+namespace soft {
+  namespace opt {
+    std::string type_key(const Type& type)
+    {
+      // f32x4 and i32x4 only differ by their lanes
+      if (type.isVector())
+        return std::format("{}:{}x{}", static_cast<int>(type.getKnd()), type_key(type.getElement()), type.getLength());
+
+      return std::format("{}:{}:{}", static_cast<int>(type.getKnd()), type.getBitwidth(), type.isSigned());
+    }
+    std::string constant_key(const Constant& constant)
+    {
+      // compare floating points by their bit pattern
+      // so -0.0 and 0.0 don't get merged
+      if (constant.isFloatValue())
+        return std::format("F {} {}", type_key(constant.getType()), std::bit_cast<uint64_t>(constant.getFloatValue()));
+
+      return std::format("I {} {}", type_key(constant.getType()), constant.getIntegerValue());
+    }
+
+    size_t value_numbering(Function& fn)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      // NOTE: a function body is a single basic block for now, so the
+      // dominator tree is just a chain and one table covers the whole body
+
+      // the current value number of every slot, variables get a new
+      // number each time they are stored to
+      std::unordered_map<size_t, size_t> numbers;
+      // the value number of every constant and computed expression
+      std::unordered_map<std::string, size_t> expressions;
+      // the first temporary that holds each value number, temporaries
+      // are written only once so they can be reused safely
+      std::unordered_map<size_t, Slot> leaders;
+      // slots of the removed instructions and what replaces them
+      std::unordered_map<size_t, Slot> replaced;
+      size_t next = 0;
+      const auto globals = global_slots(fn);
+
+      auto number_of = [&](const Value& value)
+      {
+        if (value.isConstant())
+        {
+          auto [it, inserted] = expressions.try_emplace(constant_key(value.getConstant()), next);
+          if (inserted) next++;
+          return it->second;
+        }
+
+        // parameters and variables read before any store
+        auto [it, inserted] = numbers.try_emplace(value.getSlot().getId(), next);
+        if (inserted) next++;
+        return it->second;
+      };
+      auto expression_key = [&](const Instruction& instruction)
+      {
+        const Type& type = getDestination(instruction).getType();
+        switch (instruction.index())
+        {
+          case 2: // Convert
+          {
+            const auto& convert = std::get<2>(instruction);
+            return std::format("cvt {} {}", type_key(type), number_of(convert.getSrc()));
+          }
+          case 3: // BinOp
+          {
+            const auto& binop = std::get<3>(instruction);
+            size_t l = number_of(binop.getLeft());
+            size_t r = number_of(binop.getRight());
+
+            // a + b == b + a
+            bool commutative = binop.getOp() == BinOp::Op::Add || binop.getOp() == BinOp::Op::Mul;
+            if (commutative && l > r)
+              std::swap(l, r);
+
+            return std::format("bin {} {} {} {}", static_cast<int>(binop.getOp()), type_key(type), l, r);
+          }
+          case 4: // UnOp
+          {
+            const auto& unop = std::get<4>(instruction);
+            return std::format("un {} {} {}", static_cast<int>(unop.getOp()), type_key(type), number_of(unop.getOperand()));
+          }
+          case 9: // Shuffle
+          {
+            const auto& shuffle = std::get<9>(instruction);
+            std::string key = std::format("shuf {} {}", type_key(type), number_of(shuffle.getSrc()));
+            for (size_t lane : shuffle.getLanes())
+              key += std::format(" {}", lane);
+            return key;
+          }
+          default:
+            unreachable();
+        }
+      };
+      auto rewrite = [&](Value& value)
+      {
+        if (!value.isSlot())
+          return;
+
+        if (auto it = replaced.find(value.getSlot().getId()); it != replaced.end())
+          value.setValue(it->second);
+      };
+
+      auto& body = fn.getBody();
+      std::vector<Instruction> result;
+      result.reserve(body.size());
+
+      for (auto& instruction : body)
+      {
+        for (Value* value : getOperands(instruction))
+          rewrite(*value);
+
+        Slot& dst = getDestination(instruction);
+        switch (instruction.index())
+        {
+          case 0: // Alloca
+            numbers[dst.getId()] = next++;
+            break;
+
+          case 1: // Store
+            numbers[dst.getId()] = number_of(std::get<1>(instruction).getSrc());
+            break;
+
+          // the callee may have side effects, every call is a new
+          // value and so is every global it may store to
+          case 5: // Call
+            numbers[dst.getId()] = next++;
+            for (const auto& [id, name] : globals)
+              numbers[id] = next++;
+            break;
+
+          // the memory of the arrays isn't numbered, every
+          // load and every written array is a new value
+          case 6: // LoadElement
+          case 7: // StoreElement
+          case 8: // InitArray
+            numbers[dst.getId()] = next++;
+            break;
+
+          default:
+          {
+            std::string key = expression_key(instruction);
+
+            // already computed
+            if (auto it = expressions.find(key); it != expressions.end())
+            {
+              replaced[dst.getId()] = leaders[it->second];
+              continue;
+            }
+
+            size_t number = next++;
+            expressions[key] = number;
+            numbers[dst.getId()] = number;
+            leaders[number] = dst;
+            break;
+          }
+        }
+
+        result.push_back(std::move(instruction));
+      }
+
+      if (fn.isTerminated())
+        rewrite(fn.getTerminator().getValue());
+
+      size_t removed = body.size() - result.size();
+      fn.setBody(std::move(result));
+      return removed;
+    }
+  }
+}
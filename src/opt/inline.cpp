@@ -0,0 +1,153 @@
+#include "opt/opt.h"
+
+namespace soft {
+  namespace opt {
+    // returns the instructions the call would cost once inlined
+    size_t inline_cost(const Function& callee, const Call& call)
+    {
+      const auto& body = callee.getBody();
+      const auto& params = callee.getParams();
+      size_t cost = body.size();
+
+      for (size_t i = 0; i < params.size(); ++i)
+      {
+        if (!call.getArgs()[i].isConstant())
+          continue;
+
+        for (const auto& instruction : body)
+          for (const Value* value : getOperands(instruction))
+            if (value->isSlot() && value->getSlot().getId() == params[i].getId() && cost > 0)
+              cost--;
+      }
+
+      return cost;
+    }
+
+    size_t inline_calls(Program& program, size_t threshold)
+    {
+      auto& functions = program.getFunctions();
+
+      // name -> index of the definition
+      std::unordered_map<std::string, size_t> definitions;
+      for (size_t i = 0; i < functions.size(); ++i)
+        if (functions[i].isDefined())
+          definitions[functions[i].getName()] = i;
+
+      size_t inlined = 0;
+      for (auto& fn : functions)
+      {
+        if (!fn.isDefined())
+          continue;
+
+        // the results of the inlined calls and what replaces them
+        std::unordered_map<size_t, Value> returned;
+        size_t next = fn.getTotalRegisters();
+
+        auto rewrite = [&](Value& value)
+        {
+          if (!value.isSlot())
+            return;
+
+          if (auto it = returned.find(value.getSlot().getId()); it != returned.end())
+            value = it->second;
+        };
+
+        // the caller slot of every global, the inlined bodies share it
+        // so a store through one is seen by the reads through the other
+        std::unordered_map<std::string, size_t> bound;
+        for (const auto& [id, name] : global_slots(fn))
+          bound.try_emplace(name, id);
+
+        auto& body = fn.getBody();
+        std::vector<Instruction> result;
+        result.reserve(body.size());
+
+        for (auto& instruction : body)
+        {
+          for (Value* value : getOperands(instruction))
+            rewrite(*value);
+
+          if (instruction.index() != 5) // not a Call
+          {
+            result.push_back(std::move(instruction));
+            continue;
+          }
+
+          // NOTE: only the calls of the original body are considered,
+          // so a recursive function is never expanded more than once
+          const auto& call = std::get<5>(instruction);
+          auto it = definitions.find(call.getName());
+          if (it == definitions.end() || &functions[it->second] == &fn || inline_cost(functions[it->second], call) > threshold)
+          {
+            result.push_back(std::move(instruction));
+            continue;
+          }
+
+          // the slots of the callee are renumbered after the ones of the caller
+          const Function& callee = functions[it->second];
+          const size_t base = next;
+          next += callee.getTotalRegisters();
+
+          // the callee globals the caller already has a slot for
+          std::unordered_map<size_t, size_t> shared;
+          for (const auto& [id, name] : global_slots(callee))
+          {
+            auto [it, inserted] = bound.try_emplace(name, id + base);
+            if (!inserted)
+              shared[id] = it->second;
+          }
+
+          auto renumber = [&](size_t id)
+          {
+            auto it = shared.find(id);
+            return it != shared.end() ? it->second : id + base;
+          };
+          auto rename = [&](Value& value)
+          {
+            if (value.isSlot())
+              value.getSlot().setId(renumber(value.getSlot().getId()));
+          };
+
+          // the parameters become variables that hold the arguments
+          const auto& params = callee.getParams();
+          for (size_t i = 0; i < params.size(); ++i)
+          {
+            Slot param(params[i].getType(), params[i].getId() + base);
+            result.push_back( Alloca(param.getType(), param) );
+            result.push_back( Store(call.getArgs()[i], param) );
+          }
+
+          for (Instruction copy : callee.getBody())
+          {
+            Slot& dst = getDestination(copy);
+            if (copy.index() == 0 && shared.contains(dst.getId())) // Alloca
+              continue;
+
+            dst.setId(renumber(dst.getId()));
+            for (Value* value : getOperands(copy))
+              rename(*value);
+
+            result.push_back(std::move(copy));
+          }
+
+          if (callee.isTerminated())
+          {
+            Value value = callee.getTerminator().getValue();
+            rename(value);
+            returned[call.getDst().getId()] = value;
+          }
+
+          inlined++;
+        }
+
+        if (fn.isTerminated())
+          rewrite(fn.getTerminator().getValue());
+
+        fn.setBody(std::move(result));
+        fn.setTotalRegisters(next);
+      }
+
+      return inlined;
+    }
+  }
+}
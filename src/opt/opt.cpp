@@ -0,0 +1,57 @@
+#include "opt/opt.h"
+
+namespace soft {
+  namespace opt {
+    Stats optimize(Program& program, const Opts& opts)
+    {
+      Stats stats = {
+        .removed_instructions = 0,
+        .reused_expressions = 0,
+        .folded_instructions = 0,
+        .reduced_operations = 0,
+        .propagated_copies = 0,
+        .inlined_calls = 0,
+        .vectorized_operations = 0,
+        .folded_addresses = 0,
+        .narrowed_operations = 0,
+      };
+
+      if (opts.opt_level == 0)
+        return stats;
+
+      stats.inlined_calls += inline_calls(program, opts.inline_threshold);
+
+      for (auto& fn : program.getFunctions())
+      {
+        stats.folded_instructions += constant_propagation(fn);
+        stats.propagated_copies += copy_propagation(fn);
+        stats.reduced_operations += strength_reduction(fn);
+        stats.reused_expressions += value_numbering(fn);
+        if (opts.opt_level >= 2)
+          stats.vectorized_operations += vectorize(fn, opts.arch);
+        stats.folded_addresses += fold_addresses(fn);
+        // the extensions of the 32-bit results truncated right away collapse
+        size_t narrowed = narrow_operations(fn);
+        if (narrowed > 0)
+          stats.propagated_copies += copy_propagation(fn);
+        stats.narrowed_operations += narrowed;
+        stats.removed_instructions += dead_code_elimination(fn);
+      }
+
+      return stats;
+    }
+    void print_stats(const Stats& stats)
+    {
+      std::println(stderr, "Optimization statistics:");
+      std::println(stderr, "  {} instructions removed", stats.removed_instructions);
+      std::println(stderr, "  {} expressions reused", stats.reused_expressions);
+      std::println(stderr, "  {} instructions folded", stats.folded_instructions);
+      std::println(stderr, "  {} operations strength reduced", stats.reduced_operations);
+      std::println(stderr, "  {} copies and conversions propagated", stats.propagated_copies);
+      std::println(stderr, "  {} calls inlined", stats.inlined_calls);
+      std::println(stderr, "  {} vector operations formed", stats.vectorized_operations);
+      std::println(stderr, "  {} array indices folded into the address", stats.folded_addresses);
+      std::println(stderr, "  {} operations narrowed or made unsigned", stats.narrowed_operations);
+    }
+  }
+}
@@ -0,0 +1,336 @@
+#include "opt/opt.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace soft {
+  namespace opt {
+    std::optional<Range> type_range(const Type& type)
+    {
+      if (!type.isInteger())
+        return std::nullopt;
+
+      const size_t bitwidth = type.getBitwidth();
+      if (type.isSigned())
+      {
+        if (bitwidth == 64)
+          return Range { INT64_MIN, INT64_MAX };
+        return Range { -((int64_t) 1 << (bitwidth - 1)), ((int64_t) 1 << (bitwidth - 1)) - 1 };
+      }
+
+      // the upper half of u64 isn't an int64_t
+      if (bitwidth == 64)
+        return std::nullopt;
+      return Range { 0, ((int64_t) 1 << bitwidth) - 1 };
+    }
+    bool fits(const Range& range, const Type& type)
+    {
+      if (type.isInteger(64) && !type.isSigned())
+        return range.lo >= 0;
+
+      auto full = type_range(type);
+      return full.has_value() && full->lo <= range.lo && range.hi <= full->hi;
+    }
+
+    // the range of a result computed without overflowing, if the
+    // type holds all of it, the operation wraps around otherwise
+    std::optional<Range> bounded(__int128 lo, __int128 hi, const Type& type)
+    {
+      if (lo < INT64_MIN || hi > INT64_MAX)
+        return std::nullopt;
+
+      Range range { (int64_t) lo, (int64_t) hi };
+      if (!fits(range, type))
+        return std::nullopt;
+      return range;
+    }
+
+    std::optional<Range> range_of(const std::unordered_map<size_t, Range>& ranges, const Value& value)
+    {
+      const Type& type = value.getType();
+      if (!type.isInteger())
+        return std::nullopt;
+
+      if (value.isConstant())
+      {
+        int64_t constant = value.getConstant().getIntegerValue();
+        if (!fits(Range { constant, constant }, type))
+          return std::nullopt;
+        return Range { constant, constant };
+      }
+
+      auto it = ranges.find(value.getSlot().getId());
+      if (it != ranges.end())
+        return it->second;
+      return type_range(type);
+    }
+
+    std::optional<Range> binop_range(BinOp::Op op, const Range& l, const Range& r, const Type& type)
+    {
+      const __int128 a = l.lo, b = l.hi, c = r.lo, d = r.hi;
+
+      switch (op)
+      {
+        case BinOp::Op::Add:
+          return bounded(a + c, b + d, type);
+        case BinOp::Op::Sub:
+          return bounded(a - d, b - c, type);
+        case BinOp::Op::Mul:
+        {
+          auto products = { a * c, a * d, b * c, b * d };
+          return bounded(std::min(products), std::max(products), type);
+        }
+        case BinOp::Op::Div:
+        {
+          // the quotient is monotonic in both operands as long as the
+          // divisor keeps its sign, the corners are the bounds
+          if (c < 1 && d > -1)
+            return std::nullopt;
+          auto quotients = { a / c, a / d, b / c, b / d };
+          return bounded(std::min(quotients), std::max(quotients), type);
+        }
+        case BinOp::Op::Mod:
+        {
+          // the remainder has the sign of the dividend and is
+          // smaller than the divisor
+          if (c < 1 && d > -1)
+            return std::nullopt;
+          const __int128 m = std::max(c < 0 ? -c : c, d < 0 ? -d : d) - 1;
+          return bounded(a >= 0 ? 0 : std::max(-m, a), b <= 0 ? 0 : std::min(m, b), type);
+        }
+      }
+
+      return std::nullopt;
+    }
+
+    std::unordered_map<size_t, Range> value_ranges(const Function& fn)
+    {
+      std::unordered_map<size_t, Range> ranges;
+      if (!fn.isDefined())
+        return ranges;
+
+      // the body is a single block and the temporaries are defined once,
+      // the operands are always known before the instruction reading them.
+      // The variables and the parameters keep the range of their type
+      for (const auto& instruction : fn.getBody())
+      {
+        std::optional<Range> range;
+        switch (instruction.index())
+        {
+          case 2: // Convert
+          {
+            const auto& convert = std::get<2>(instruction);
+            auto src = range_of(ranges, convert.getSrc());
+            if (src.has_value() && fits(*src, convert.getDst().getType()))
+              range = src;
+            break;
+          }
+          case 3: // BinOp
+          {
+            const auto& binop = std::get<3>(instruction);
+            auto l = range_of(ranges, binop.getLeft());
+            auto r = range_of(ranges, binop.getRight());
+            if (l.has_value() && r.has_value() && binop.getDst().getType().isInteger())
+              range = binop_range(binop.getOp(), *l, *r, binop.getDst().getType());
+            break;
+          }
+        }
+
+        if (range.has_value())
+          ranges[getDestination(instruction).getId()] = *range;
+      }
+
+      return ranges;
+    }
+
+    size_t narrow_operations(Function& fn)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      auto ranges = value_ranges(fn);
+      auto& body = fn.getBody();
+
+      // the variables may be stored to between the extension and the
+      // operation, only the temporaries and the parameters never stored
+      // to can be read again where the operation is
+      std::unordered_set<size_t> variables;
+      for (const auto& instruction : body)
+        if (instruction.index() == 0 || instruction.index() == 1) // Alloca, Store
+          variables.insert(getDestination(instruction).getId());
+
+      // 64-bit slot id -> the 32-bit or narrower value it was extended from
+      std::unordered_map<size_t, Value> widened;
+
+      std::vector<Instruction> result;
+      size_t next = fn.getTotalRegisters();
+      size_t narrowed = 0;
+
+      auto in_range = [&](const Value& value, const Type& type)
+      {
+        auto range = range_of(ranges, value);
+        return range.has_value() && fits(*range, type);
+      };
+
+      // the operand of the 32-bit operation, converted in front of it.
+      // The truncations cost a move, only the divisions are worth them
+      auto narrow_operand = [&](const Value& value, const Type& narrow, bool truncate) -> std::optional<Value>
+      {
+        if (value.isConstant())
+          return Value(Constant(narrow, value.getConstant().getIntegerValue()));
+
+        const Value* src = &value;
+        if (widened.contains(value.getSlot().getId()))
+          src = &widened[value.getSlot().getId()];
+        else if (!truncate)
+          return std::nullopt;
+
+        // the value fits in both, the 32-bit signedness is only the name
+        if (src->getType().cmpTo(narrow))
+        {
+          Value same = *src;
+          same.getType().setSigned(narrow.isSigned());
+          return same;
+        }
+
+        Slot converted(narrow, next++);
+        ranges[converted.getId()] = *range_of(ranges, *src);
+        result.push_back(Convert(*src, converted));
+        return Value(converted);
+      };
+
+      // the signed division of a value that is never negative by a positive
+      // constant is the unsigned one, which needs no rounding fix-up. The
+      // bits are the same whatever the readers think the signedness is
+      auto unsign = [&](BinOp& binop)
+      {
+        const Value& right = binop.getRight();
+        if (binop.getOp() != BinOp::Op::Div && binop.getOp() != BinOp::Op::Mod)
+          return;
+        if (!binop.getDst().getType().isInteger() || !binop.getDst().getType().isSigned() || !binop.getLeft().isSlot())
+          return;
+        if (!right.isConstant() || right.getConstant().getIntegerValue() < 1)
+          return;
+
+        auto left = range_of(ranges, binop.getLeft());
+        if (!left.has_value() || left->lo < 0)
+          return;
+
+        binop.getLeft().getType().setSigned(false);
+        binop.getRight().getConstant().getType().setSigned(false);
+        binop.getDst().getType().setSigned(false);
+        narrowed++;
+      };
+
+      // the zero extension of a value that is never negative is the
+      // same, and the 32 -> 64 one is a `movl` that may not be needed
+      auto zero_extend = [&](Value& src)
+      {
+        auto range = range_of(ranges, src);
+        if (!src.getType().isSigned() || !range.has_value() || range->lo < 0)
+          return false;
+
+        src.getType().setSigned(false);
+        return true;
+      };
+
+      for (auto& instruction : body)
+      {
+        if (instruction.index() == 2) // Convert
+        {
+          auto& convert = std::get<2>(instruction);
+          Value& src = convert.getSrc();
+          const Type& type = convert.getDst().getType();
+
+          if (!src.isSlot() || !src.getType().isInteger() || !type.isInteger() || src.getType().getBitwidth() >= type.getBitwidth())
+          {
+            result.push_back(std::move(instruction));
+            continue;
+          }
+
+          if (zero_extend(src))
+            narrowed++;
+
+          if (type.getBitwidth() == 64 && src.getType().getBitwidth() <= 32 && !variables.contains(src.getSlot().getId()))
+            widened[convert.getDst().getId()] = src;
+
+          result.push_back(std::move(instruction));
+          continue;
+        }
+
+        if (instruction.index() != 3) // BinOp
+        {
+          result.push_back(std::move(instruction));
+          continue;
+        }
+
+        auto& binop = std::get<3>(instruction);
+        const Slot& dst = binop.getDst();
+        const Value& left = binop.getLeft();
+        const Value& right = binop.getRight();
+
+        Type narrow = dst.getType();
+        narrow.setBitwidth(32);
+
+        bool candidate = dst.getType().isInteger(64) && left.getType().isInteger(64) && right.getType().isInteger(64)
+          && in_range(Value(dst), narrow) && in_range(left, narrow) && in_range(right, narrow);
+
+        // one of the extensions goes away, or the chain it starts continues
+        // at 32 bits. The 64-bit `div` is much slower than the 32-bit one
+        // whatever it costs to truncate its operands, the constant ones
+        // are multiplications already
+        auto extended = [&](const Value& value) { return value.isSlot() && widened.contains(value.getSlot().getId()); };
+        auto exact = [&](const Value& value)
+        {
+          return extended(value) && widened[value.getSlot().getId()].getType().getBitwidth() == 32;
+        };
+
+        bool truncate = false;
+        if (binop.getOp() == BinOp::Op::Div || binop.getOp() == BinOp::Op::Mod)
+        {
+          truncate = !right.isConstant();
+          candidate = candidate && (truncate || extended(left));
+
+          // INT32_MIN / -1 overflows at 32 bits
+          auto l = range_of(ranges, left);
+          auto r = range_of(ranges, right);
+          if (candidate && narrow.isSigned() && l->lo == INT32_MIN && r->lo <= -1 && r->hi >= -1)
+            candidate = false;
+        }
+        else
+        {
+          candidate = candidate && (left.isConstant() || extended(left)) && (right.isConstant() || extended(right))
+            && (exact(left) || exact(right));
+        }
+
+        if (!candidate)
+        {
+          unsign(binop);
+          result.push_back(std::move(instruction));
+          continue;
+        }
+
+        auto l = narrow_operand(left, narrow, truncate);
+        auto r = narrow_operand(right, narrow, truncate);
+
+        Slot computed(narrow, next++);
+        ranges[computed.getId()] = ranges[dst.getId()];
+        BinOp operation(*l, *r, binop.getOp(), computed);
+        unsign(operation);
+        result.push_back(std::move(operation));
+
+        // the original slot is now the extension of the 32-bit result
+        // and the operations reading it can be narrowed in turn
+        Slot original = dst;
+        Value extension(computed);
+        zero_extend(extension);
+        widened[original.getId()] = extension;
+        result.push_back(Convert(extension, original));
+        narrowed++;
+      }
+
+      body = std::move(result);
+      fn.setTotalRegisters(next);
+      return narrowed;
+    }
+  }
+}
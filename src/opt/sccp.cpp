@@ -0,0 +1,114 @@
+#include "opt/opt.h"
+#include "common.h"
+
+namespace soft {
+  namespace opt {
+    size_t constant_propagation(Function& fn)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      // NOTE: there are no branches yet, so every instruction is reachable
+      // and a single forward walk reaches the fixed point
+
+      // the slots known to hold a constant at the current point
+      std::unordered_map<size_t, Constant> constants;
+      const auto globals = global_slots(fn);
+
+      auto rewrite = [&](Value& value)
+      {
+        if (!value.isSlot())
+          return;
+
+        if (auto it = constants.find(value.getSlot().getId()); it != constants.end())
+          value.setValue(it->second);
+      };
+
+      auto& body = fn.getBody();
+      std::vector<Instruction> result;
+      result.reserve(body.size());
+
+      for (auto& instruction : body)
+      {
+        for (Value* value : getOperands(instruction))
+          rewrite(*value);
+
+        Slot& dst = getDestination(instruction);
+        std::optional<Constant> folded;
+
+        switch (instruction.index())
+        {
+          case 0: // Alloca
+          {
+            constants.erase(dst.getId());
+            break;
+          }
+          case 1: // Store
+          {
+            const Value& src = std::get<1>(instruction).getSrc();
+
+            // the variable is still written, we only learn its value
+            if (src.isConstant())
+              constants[dst.getId()] = fold_cast(src.getConstant(), dst.getType());
+            else
+              constants.erase(dst.getId());
+            break;
+          }
+          case 2: // Convert
+          {
+            const Value& src = std::get<2>(instruction).getSrc();
+            if (src.isConstant())
+              folded = fold_cast(src.getConstant(), dst.getType());
+            break;
+          }
+          case 3: // BinOp
+          {
+            const auto& binop = std::get<3>(instruction);
+            if (binop.getLeft().isConstant() && binop.getRight().isConstant())
+              folded = fold(binop.getOp(), binop.getLeft().getConstant(), binop.getRight().getConstant(), dst.getType());
+            break;
+          }
+          case 4: // UnOp
+          {
+            const auto& unop = std::get<4>(instruction);
+            if (unop.getOperand().isConstant())
+              folded = fold(unop.getOp(), unop.getOperand().getConstant(), dst.getType());
+            break;
+          }
+          // the callee may store to the globals
+          case 5: // Call
+          {
+            for (const auto& [id, name] : globals)
+              constants.erase(id);
+            break;
+          }
+          // the elements of the arrays aren't tracked
+          case 6: // LoadElement
+          case 7: // StoreElement
+          case 8: // InitArray
+            break;
+          // neither are the lanes of the vectors
+          case 9: // Shuffle
+            break;
+          default:
+            unreachable();
+        }
+
+        if (folded.has_value())
+        {
+          constants[dst.getId()] = *folded;
+          continue;
+        }
+
+        result.push_back(std::move(instruction));
+      }
+
+      if (fn.isTerminated())
+        rewrite(fn.getTerminator().getValue());
+
+      size_t removed = body.size() - result.size();
+      fn.setBody(std::move(result));
+      return removed;
+    }
+  }
+}
@@ -0,0 +1,164 @@
+#include "opt/opt.h"
+#include <cmath>
+#include <unordered_set>
+
+namespace soft {
+  namespace opt {
+    bool isConstant(const Value& value, int64_t integer)
+    {
+      if (!value.isConstant())
+        return false;
+
+      const Constant& constant = value.getConstant();
+      if (constant.isIntegerValue())
+        return constant.getIntegerValue() == integer;
+
+      return constant.getFloatValue() == (double) integer;
+    }
+    // returns 1/c if it is exactly representable in the type,
+    // which is the case for the powers of two
+    std::optional<double> exact_reciprocal(const Constant& constant, const Type& type)
+    {
+      double value = constant.getFloatValue();
+      if (value == 0 || !std::isfinite(value))
+        return std::nullopt;
+
+      int exponent;
+      if (std::abs(std::frexp(value, &exponent)) != 0.5)
+        return std::nullopt;
+
+      double reciprocal = 1.0 / value;
+      if (type.getBitwidth() == 32 ? !std::isnormal((float) reciprocal) : !std::isnormal(reciprocal))
+        return std::nullopt;
+
+      return reciprocal;
+    }
+
+    size_t strength_reduction(Function& fn)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      // slots of the removed instructions and what replaces them
+      std::unordered_map<size_t, Value> replaced;
+      size_t reduced = 0;
+
+      // variables may be stored to after the removed instruction, so
+      // only constants and temporaries can replace it
+      std::unordered_set<size_t> variables;
+      for (const auto& param : fn.getParams())
+        variables.insert(param.getId());
+      for (const auto& instruction : fn.getBody())
+        if (instruction.index() == 0) // Alloca
+          variables.insert(getDestination(instruction).getId());
+
+      auto replaceable = [&](const Value& value)
+      {
+        return value.isConstant() || variables.find(value.getSlot().getId()) == variables.end();
+      };
+
+      auto rewrite = [&](Value& value)
+      {
+        if (!value.isSlot())
+          return;
+
+        if (auto it = replaced.find(value.getSlot().getId()); it != replaced.end())
+          value = it->second;
+      };
+
+      auto& body = fn.getBody();
+      std::vector<Instruction> result;
+      result.reserve(body.size());
+
+      for (auto& instruction : body)
+      {
+        for (Value* value : getOperands(instruction))
+          rewrite(*value);
+
+        if (instruction.index() != 3) // not a BinOp
+        {
+          result.push_back(std::move(instruction));
+          continue;
+        }
+
+        auto& binop = std::get<3>(instruction);
+        const Type& type = binop.getDst().getType();
+        const size_t dst = binop.getDst().getId();
+
+        switch (binop.getOp())
+        {
+          case BinOp::Op::Mul:
+          {
+            // keep the constant on the right, codegen selects
+            // shifts and `lea` from there
+            if (binop.getLeft().isConstant() && !binop.getRight().isConstant())
+            {
+              Value left = binop.getLeft();
+              binop.setLeft(binop.getRight());
+              binop.setRight(left);
+            }
+
+            // x * 1 = x
+            if (isConstant(binop.getRight(), 1) && replaceable(binop.getLeft()))
+            {
+              replaced[dst] = binop.getLeft();
+              reduced++;
+              continue;
+            }
+            // x * 0 = 0, floats keep it (NaN, inf and -0.0)
+            if (type.isInteger() && isConstant(binop.getRight(), 0))
+            {
+              replaced[dst] = Value(Constant(type, (int64_t) 0));
+              reduced++;
+              continue;
+            }
+            break;
+          }
+          case BinOp::Op::Div:
+          {
+            // x / 1 = x
+            if (isConstant(binop.getRight(), 1) && replaceable(binop.getLeft()))
+            {
+              replaced[dst] = binop.getLeft();
+              reduced++;
+              continue;
+            }
+
+            // x / c = x * (1 / c) when 1 / c is exact
+            if (type.isFloatingPoint() && binop.getRight().isConstant())
+            {
+              if (auto reciprocal = exact_reciprocal(binop.getRight().getConstant(), type))
+              {
+                binop.setOp(BinOp::Op::Mul);
+                binop.setRight(Value(Constant(type, *reciprocal)));
+                reduced++;
+              }
+            }
+            break;
+          }
+          case BinOp::Op::Mod:
+          {
+            // x % 1 = 0
+            if (isConstant(binop.getRight(), 1))
+            {
+              replaced[dst] = Value(Constant(type, (int64_t) 0));
+              reduced++;
+              continue;
+            }
+            break;
+          }
+          default:
+            break;
+        }
+
+        result.push_back(std::move(instruction));
+      }
+
+      if (fn.isTerminated())
+        rewrite(fn.getTerminator().getValue());
+
+      fn.setBody(std::move(result));
+      return reduced;
+    }
+  }
+}
@@ -0,0 +1,254 @@
+#include "opt/opt.h"
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+
+namespace soft {
+  namespace opt {
+    // `dst[k] = a[i] op b[j]` with constant indices, one lane of a
+    // vector operation if the next elements are computed the same way
+    struct Lane {
+      size_t store;
+      size_t left;
+      size_t right;
+      BinOp::Op op;
+      size_t dst, a, b;
+      int64_t k, i, j;
+    };
+
+    // returns the number of lanes a vector of `type` has in the widest
+    // registers the target has, 0 if the operation can't be packed
+    size_t lanes(const Type& type, BinOp::Op op, Arch arch)
+    {
+      const size_t width = arch >= Arch::X86_64_V3 ? 32 : 16;
+      const size_t size = type.getByteSize();
+
+      if (type.isFloatingPoint())
+      {
+        if (op != BinOp::Op::Add && op != BinOp::Op::Sub && op != BinOp::Op::Mul && op != BinOp::Op::Div)
+          return 0;
+        return width / size;
+      }
+
+      // there's no packed division and `pmulld` is SSE4.1, no 64-bit one
+      if (size < 4 || (op != BinOp::Op::Add && op != BinOp::Op::Sub && op != BinOp::Op::Mul))
+        return 0;
+      if (op == BinOp::Op::Mul && (size != 4 || arch < Arch::X86_64_V2))
+        return 0;
+      return width / size;
+    }
+
+    size_t vectorize(Function& fn, Arch arch)
+    {
+      if (!fn.isDefined())
+        return 0;
+
+      auto& body = fn.getBody();
+      const Type wide(Type::Knd::Integer, 64);
+
+      // the arrays calls can read and write
+      std::unordered_set<size_t> globals;
+      for (const auto& [id, name] : global_slots(fn))
+        globals.insert(id);
+
+      // slot id -> the position of its `BinOp` or `LoadElement`
+      std::unordered_map<size_t, size_t> defs;
+      for (size_t i = 0; i < body.size(); ++i)
+        if (body[i].index() == 3 || body[i].index() == 6)
+          defs[getDestination(body[i]).getId()] = i;
+
+      // the element of a constant index read from an array
+      auto element = [&](const Value& value) -> std::optional<std::pair<size_t, int64_t>>
+      {
+        if (!value.isSlot() || !defs.contains(value.getSlot().getId()))
+          return std::nullopt;
+
+        const auto& instruction = body[defs[value.getSlot().getId()]];
+        if (instruction.index() != 6)
+          return std::nullopt;
+
+        const auto& load = std::get<6>(instruction);
+        if (!load.getIndex().isConstant())
+          return std::nullopt;
+        return std::make_pair(load.getArray().getSlot().getId(), load.getIndex().getConstant().getIntegerValue());
+      };
+
+      // (array, index) -> the lane stored there
+      std::map<std::pair<size_t, int64_t>, Lane> stores;
+      for (size_t s = 0; s < body.size(); ++s)
+      {
+        if (body[s].index() != 7) // StoreElement
+          continue;
+
+        const auto& store = std::get<7>(body[s]);
+        const Value& src = store.getSrc();
+        if (!store.getIndex().isConstant() || !src.isSlot() || !defs.contains(src.getSlot().getId()))
+          continue;
+
+        const auto& instruction = body[defs[src.getSlot().getId()]];
+        if (instruction.index() != 3)
+          continue;
+
+        const auto& binop = std::get<3>(instruction);
+        auto left = element(binop.getLeft());
+        auto right = element(binop.getRight());
+        if (!left.has_value() || !right.has_value())
+          continue;
+
+        // no conversion on the way
+        const Type& type = store.getDst().getType().getElement();
+        if (!binop.getLeft().getType().cmpTo(type) || !binop.getRight().getType().cmpTo(type) || !binop.getDst().getType().cmpTo(type))
+          continue;
+
+        Lane lane = {
+          .store = s,
+          .left = defs[binop.getLeft().getSlot().getId()],
+          .right = defs[binop.getRight().getSlot().getId()],
+          .op = binop.getOp(),
+          .dst = store.getDst().getId(),
+          .a = left->first,
+          .b = right->first,
+          .k = store.getIndex().getConstant().getIntegerValue(),
+          .i = left->second,
+          .j = right->second,
+        };
+        // the last store to an element wins, an earlier one is not a lane
+        stores[{ lane.dst, lane.k }] = lane;
+      }
+
+      // the stores replaced by a vector one, and the instructions that
+      // replace the last store of every group
+      std::unordered_set<size_t> removed;
+      std::unordered_map<size_t, std::vector<Instruction>> replacements;
+      size_t next = fn.getTotalRegisters();
+      size_t vectorized = 0;
+
+      for (const auto& [key, first] : stores)
+      {
+        if (removed.contains(first.store))
+          continue;
+
+        const Slot& array = std::get<7>(body[first.store]).getDst();
+        const Type& type = array.getType().getElement();
+        size_t count = lanes(type, first.op, arch);
+
+        // the widest vector whose lanes are all there, then a smaller one
+        std::vector<Lane> group;
+        for (; count >= 2 && group.empty(); count /= 2)
+        {
+          if (type.getByteSize() * count < 16)
+            break;
+
+          for (size_t l = 0; l < count; ++l)
+          {
+            auto it = stores.find({ first.dst, first.k + (int64_t) l });
+            if (it == stores.end() || removed.contains(it->second.store))
+              break;
+
+            const Lane& lane = it->second;
+            if (lane.op != first.op || lane.a != first.a || lane.b != first.b
+                || lane.i != first.i + (int64_t) l || lane.j != first.j + (int64_t) l)
+              break;
+
+            group.push_back(lane);
+          }
+
+          if (group.size() != count)
+            group.clear();
+        }
+        if (group.empty())
+          continue;
+        count = group.size();
+
+        // the vector reads past the end of a source array
+        const Type& left_type = std::get<6>(body[first.left]).getArray().getType();
+        const Type& right_type = std::get<6>(body[first.right]).getArray().getType();
+        if (first.i + (int64_t) count > (int64_t) left_type.getLength() || first.j + (int64_t) count > (int64_t) right_type.getLength())
+          continue;
+
+        // the vector lanes are read where the last one is stored, all at
+        // once. The arrays are distinct objects, so only the accesses to
+        // the same array in between can change the result
+        size_t start = body.size();
+        size_t end = 0;
+        size_t stored = body.size();
+        std::unordered_set<size_t> positions;
+        for (const Lane& lane : group)
+        {
+          start = std::min({ start, lane.left, lane.right });
+          end = std::max(end, lane.store);
+          stored = std::min(stored, lane.store);
+          positions.insert({ lane.store, lane.left, lane.right });
+        }
+
+        // the group's own loads and stores are fine if the lane `l` only
+        // writes the element it read itself
+        bool legal = (first.a != first.dst || first.i == first.k) && (first.b != first.dst || first.j == first.k);
+        for (size_t p = start; p <= end && legal; ++p)
+        {
+          if (positions.contains(p))
+            continue;
+
+          const auto& instruction = body[p];
+          switch (instruction.index())
+          {
+            case 5: // Call
+              legal = !globals.contains(first.dst) && !globals.contains(first.a) && !globals.contains(first.b);
+              break;
+            case 6: // LoadElement
+            {
+              // the stores to `dst` happen later now
+              size_t source = std::get<6>(instruction).getArray().getSlot().getId();
+              legal = source != first.dst || p < stored;
+              break;
+            }
+            case 7: // StoreElement
+            case 8: // InitArray
+            {
+              size_t target = getDestination(instruction).getId();
+              legal = target != first.dst && target != first.a && target != first.b;
+              break;
+            }
+          }
+        }
+        if (!legal)
+          continue;
+
+        const Type vector(Type::Knd::Vector, type, count);
+        const LoadElement& left = std::get<6>(body[first.left]);
+        const LoadElement& right = std::get<6>(body[first.right]);
+
+        Slot a(vector, next++);
+        Slot b(vector, next++);
+        Slot result(vector, next++);
+
+        auto& code = replacements[end];
+        code.push_back(LoadElement(left.getArray(), Value(Constant(wide, first.i)), a));
+        code.push_back(LoadElement(right.getArray(), Value(Constant(wide, first.j)), b));
+        code.push_back(BinOp(Value(a), Value(b), first.op, result));
+        code.push_back(StoreElement(Value(result), Value(Constant(wide, first.k)), array));
+
+        for (const Lane& lane : group)
+          removed.insert(lane.store);
+        vectorized++;
+      }
+
+      if (vectorized == 0)
+        return 0;
+
+      // the scalar operations are dead now, `dead_code_elimination` removes them
+      std::vector<Instruction> result;
+      for (size_t i = 0; i < body.size(); ++i)
+      {
+        if (replacements.contains(i))
+          result.insert(result.end(), replacements[i].begin(), replacements[i].end());
+        else if (!removed.contains(i))
+          result.push_back(std::move(body[i]));
+      }
+
+      body = std::move(result);
+      fn.setTotalRegisters(next);
+      return vectorized;
+    }
+  }
+}
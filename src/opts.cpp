@@ -4,6 +4,28 @@
 #include <string.h>
 
 namespace soft {
+  Cpu parse_cpu(const char* option, const char* name)
+  {
+    if (strcmp(name, "generic") == 0) return Cpu::Generic;
+    if (strcmp(name, "haswell") == 0) return Cpu::Haswell;
+    if (strcmp(name, "skylake") == 0) return Cpu::Skylake;
+    if (strcmp(name, "znver3") == 0) return Cpu::Znver3;
+
+    std::println("Error: unknown CPU '{}' for {}", name, option);
+    exit(1);
+  }
+
+  Arch parse_arch(const char* name)
+  {
+    if (strcmp(name, "x86-64") == 0) return Arch::X86_64;
+    if (strcmp(name, "x86-64-v2") == 0) return Arch::X86_64_V2;
+    if (strcmp(name, "x86-64-v3") == 0) return Arch::X86_64_V3;
+    if (strcmp(name, "x86-64-v4") == 0) return Arch::X86_64_V4;
+
+    std::println("Error: unknown architecture '{}' for -march", name);
+    exit(1);
+  }
+
   Opts parse_opts(int argc, char *argv[])
   {
     Opts opts = 
@@ -15,6 +37,13 @@ namespace soft {
       .just_compile = false,
       .save_temps = false,
       .help = false,
+      .stats = false,
+      .opt_level = 1,
+      .inline_threshold = 24,
+      .unroll = 8,
+      .tune = Cpu::Generic,
+      .arch = Arch::X86_64,
+      .fp_contract = false,
     };
 
     opts.program = argv[0];
@@ -22,7 +51,7 @@ namespace soft {
       if (strcmp(argv[i], "-o") == 0) 
       {
         assert(opts.output_file == nullptr);
-        opts.output_file = argv[i++];
+        opts.output_file = argv[++i];
       }
 
       else if (strcmp(argv[i], "-S") == 0)
@@ -40,6 +69,52 @@ namespace soft {
         opts.save_temps = true;
       }
 
+      else if (strncmp(argv[i], "-O", 2) == 0)
+      {
+        opts.opt_level = atoi(argv[i] + 2);
+      }
+
+      else if (strncmp(argv[i], "--inline-threshold=", 19) == 0)
+      {
+        opts.inline_threshold = atoi(argv[i] + 19);
+      }
+
+      else if (strncmp(argv[i], "--unroll=", 9) == 0)
+      {
+        int factor = atoi(argv[i] + 9);
+        if (factor < 1)
+        {
+          std::println("Error: --unroll needs a factor of at least 1");
+          exit(1);
+        }
+        opts.unroll = factor;
+      }
+
+      else if (strncmp(argv[i], "-mtune=", 7) == 0)
+      {
+        opts.tune = parse_cpu("-mtune", argv[i] + 7);
+      }
+
+      else if (strncmp(argv[i], "-march=", 7) == 0)
+      {
+        opts.arch = parse_arch(argv[i] + 7);
+      }
+
+      else if (strcmp(argv[i], "-ffp-contract=fast") == 0)
+      {
+        opts.fp_contract = true;
+      }
+
+      else if (strcmp(argv[i], "-ffp-contract=off") == 0)
+      {
+        opts.fp_contract = false;
+      }
+
+      else if (strcmp(argv[i], "--stats") == 0)
+      {
+        opts.stats = true;
+      }
+
       else if (strcmp(argv[i], "--help") == 0)
       {
         opts.help = true;
@@ -48,7 +123,7 @@ namespace soft {
       else {
         // multiple input files are not supported for now
         assert(opts.input_file == nullptr);
-        opts.input_file = argv[i++];
+        opts.input_file = argv[i];
       }
     }
 
@@ -63,9 +138,22 @@ namespace soft {
     std::println("Options:");
     std::println("  -o <output>   specifies the output file");
     std::println("  -S            only compile, don't link");
+    std::println("  -O<level>     optimization level (0-2, default 1)");
+    std::println("  -mtune=<cpu>  schedule the instructions for the CPU (generic, haswell,");
+    std::println("                skylake, znver3), used with -O2");
+    std::println("  -march=<arch> the instructions the code may use (x86-64, x86-64-v2,");
+    std::println("                x86-64-v3, x86-64-v4), v3 and up use AVX and -O2 packs");
+    std::println("                the array arithmetic in its 32-byte vectors, f32x8 needs v3");
+    std::println("  -ffp-contract=fast|off");
+    std::println("                fuse a * b + c into an FMA with -march=x86-64-v3 (default off)");
     std::println();
     std::println("  --emit-asm    emit assembly into the output file");
     std::println("  --save-temps  saves the temporary files");
+    std::println("  --stats       print optimization statistics");
+    std::println("  --inline-threshold=<n>");
+    std::println("                inline the calls to functions of at most n instructions (default 24)");
+    std::println("  --unroll=<n>  copy the array literals n vector registers per loop iteration,");
+    std::println("                the ones of less than 2n are copied without a loop (default 8)");
     std::println("  --help        print this help");
     exit(ec);
   }
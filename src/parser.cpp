@@ -49,6 +49,7 @@ namespace soft {
           return 10;
         case Token::Knd::Mul:
         case Token::Knd::Div:
+        case Token::Knd::Mod:
           return 20;
         default:
           return 0;
@@ -357,6 +358,29 @@ namespace soft {
 
     std::unique_ptr<Type> generate_type()
     {
+      // [type; length]
+      if (match(Token::Knd::OpenBracket))
+      {
+        advance();
+        std::unique_ptr<Type> element = generate_type();
+        expect(Token::Knd::SemiColon);
+        uint64_t length = generate_integer(expect(Token::Knd::IntLit).form);
+        expect(Token::Knd::CloseBracket);
+
+        if (element->isArray())
+        {
+          std::println("Arrays of arrays are not supported");
+          exit(1);
+        }
+        if (length == 0)
+        {
+          std::println("The length of an array must be at least 1");
+          exit(1);
+        }
+
+        return std::make_unique<Type>(Type(*element, length));
+      }
+
       Token token = expect(Token::Knd::DataType);
 
       Type type;
@@ -370,7 +394,12 @@ namespace soft {
           type.setKnd(Type::Knd::Float);
       }
 
-      type.setBitwidth(generate_integer(token.form.substr(1)));
+      // f32x4: the lanes of a vector
+      size_t x = token.form.find('x');
+      type.setBitwidth(generate_integer(token.form.substr(1, x - 1)));
+      if (x != std::string::npos)
+        return std::make_unique<Type>(Type(Type::Knd::Vector, type, generate_integer(token.form.substr(x + 1))));
+
       return std::make_unique<Type>(type);
     }
     std::unique_ptr<Expr> generate_primary()
@@ -404,6 +433,18 @@ namespace soft {
 
           auto ide = std::make_unique<Identifier>();
           ide->name = name;
+
+          // indexing
+          if (match(Token::Knd::OpenBracket))
+          {
+            advance();
+            auto index = std::make_unique<Index>();
+            index->array = std::make_unique<Expr>(std::move(ide));
+            index->index = generate_expression();
+            expect(Token::Knd::CloseBracket);
+            return std::make_unique<Expr>(std::move(index));
+          }
+
           return std::make_unique<Expr>(std::move(ide));
         }
         case Token::Knd::IntLit:
@@ -445,6 +486,24 @@ namespace soft {
 
           return std::make_unique<Expr>(std::move(decl));
         }
+        case Token::Knd::OpenBracket:
+        {
+          advance(); // [
+          auto arr = std::make_unique<ArrLit>();
+
+          do {
+            if (match(Token::Knd::CloseBracket))
+              break;
+
+            if (match(Token::Knd::Comma))
+              advance();
+
+            arr->elms.push_back(generate_expression());
+          } while (match(Token::Knd::Comma));
+
+          expect(Token::Knd::CloseBracket); // ]
+          return std::make_unique<Expr>(std::move(arr));
+        }
         case Token::Knd::OpenParent: 
         {
           advance(); // (